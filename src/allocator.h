@@ -0,0 +1,172 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+#include "../libs/nlohmann/json.hpp"
+
+#if defined(BLOCKTHETWEET_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#elif defined(BLOCKTHETWEET_MIMALLOC)
+#include <mimalloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+// Function to get the name of the allocator linked into the binary
+inline std::string allocatorName() {
+#if defined(BLOCKTHETWEET_JEMALLOC)
+    return "jemalloc";
+#elif defined(BLOCKTHETWEET_MIMALLOC)
+    return "mimalloc";
+#elif defined(__GLIBC__)
+    return "glibc";
+#else
+    return "system";
+#endif
+}
+
+#if defined(BLOCKTHETWEET_JEMALLOC)
+// Function to read a jemalloc statistic, refreshed by the last "epoch" write
+template <typename T>
+T jemallocRead(const char* name) {
+    T value{};
+    size_t size = sizeof(value);
+    if (mallctl(name, &value, &size, nullptr, 0) != 0) return T{};
+    return value;
+}
+
+// Function to write a runtime-writable jemalloc setting
+template <typename T>
+void jemallocWrite(const std::string& name, T value) {
+    if (mallctl(name.c_str(), nullptr, nullptr, &value, sizeof(value)) != 0) {
+        throw std::runtime_error("jemalloc rejected option: " + name);
+    }
+}
+#endif
+
+// Function to apply an allocator tuning option given as "name=value"
+inline void applyAllocatorOption(const std::string& option) {
+    auto equals = option.find('=');
+    if (equals == std::string::npos) {
+        throw std::invalid_argument("Allocator option must be name=value: " + option);
+    }
+    std::string name = option.substr(0, equals);
+    long long value = std::stoll(option.substr(equals + 1));
+
+#if defined(BLOCKTHETWEET_JEMALLOC)
+    if (name == "dirty_decay_ms" || name == "muzzy_decay_ms") {
+        // Applies to all existing arenas and becomes the default for new ones
+        jemallocWrite<ssize_t>("arena." + std::to_string(MALLCTL_ARENAS_ALL) + "." + name, value);
+        jemallocWrite<ssize_t>("arenas." + name, value);
+    }
+    else if (name == "background_thread") {
+        jemallocWrite<bool>(name, value != 0);
+    }
+    else if (name == "max_background_threads") {
+        jemallocWrite<size_t>(name, value);
+    }
+    else {
+        throw std::invalid_argument("Unknown jemalloc option: " + name);
+    }
+#elif defined(BLOCKTHETWEET_MIMALLOC)
+    static const std::array<std::pair<const char*, mi_option_t>, 5> options = { {
+        {"eager_commit", mi_option_eager_commit},
+        {"arena_eager_commit", mi_option_arena_eager_commit},
+        {"large_os_pages", mi_option_large_os_pages},
+        {"reserve_huge_os_pages", mi_option_reserve_huge_os_pages},
+        {"purge_delay", mi_option_purge_delay}
+    } };
+    for (const auto& [optionName, optionId] : options) {
+        if (name == optionName) {
+            mi_option_set(optionId, static_cast<long>(value));
+            return;
+        }
+    }
+    throw std::invalid_argument("Unknown mimalloc option: " + name);
+#elif defined(__GLIBC__)
+    static const std::array<std::pair<const char*, int>, 4> options = { {
+        {"arena_max", M_ARENA_MAX},
+        {"mmap_threshold", M_MMAP_THRESHOLD},
+        {"trim_threshold", M_TRIM_THRESHOLD},
+        {"top_pad", M_TOP_PAD}
+    } };
+    for (const auto& [optionName, optionId] : options) {
+        if (name == optionName) {
+            if (mallopt(optionId, static_cast<int>(value)) != 1) {
+                throw std::runtime_error("mallopt rejected option: " + name);
+            }
+            return;
+        }
+    }
+    throw std::invalid_argument("Unknown malloc option: " + name);
+#else
+    throw std::invalid_argument("Allocator options are not supported by the system allocator: " + name);
+#endif
+}
+
+// Function to measure the mean latency of a small malloc/free mix on the calling thread
+inline double probeAllocationLatency(size_t iterations = 4096) {
+    std::array<void*, 64> blocks{};
+
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < iterations; i++) {
+        auto& block = blocks[i % blocks.size()];
+        std::free(block);
+        block = std::malloc(size_t(16) << (i % 6));
+        if (block) static_cast<volatile char*>(block)[0] = 0;
+    }
+    for (auto block : blocks) std::free(block);
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(end - begin).count() / iterations;
+}
+
+// Function to collect statistics of the linked allocator
+inline nlohmann::json allocatorStats() {
+    auto stats = nlohmann::json{
+        {"name", allocatorName()},
+        {"probeNsPerAllocation", probeAllocationLatency()}
+    };
+
+#if defined(BLOCKTHETWEET_JEMALLOC)
+    // Writing the epoch refreshes the cached statistics
+    uint64_t epoch = 1;
+    size_t epochSize = sizeof(epoch);
+    mallctl("epoch", &epoch, &epochSize, &epoch, epochSize);
+
+    stats["allocatedBytes"] = jemallocRead<size_t>("stats.allocated");
+    stats["activeBytes"] = jemallocRead<size_t>("stats.active");
+    stats["metadataBytes"] = jemallocRead<size_t>("stats.metadata");
+    stats["residentBytes"] = jemallocRead<size_t>("stats.resident");
+    stats["mappedBytes"] = jemallocRead<size_t>("stats.mapped");
+    stats["retainedBytes"] = jemallocRead<size_t>("stats.retained");
+    stats["arenas"] = jemallocRead<unsigned>("arenas.narenas");
+    stats["backgroundThread"] = jemallocRead<bool>("background_thread");
+#elif defined(BLOCKTHETWEET_MIMALLOC)
+    size_t elapsedMs, userMs, systemMs, currentRss, peakRss, currentCommit, peakCommit, pageFaults;
+    mi_process_info(&elapsedMs, &userMs, &systemMs, &currentRss, &peakRss, &currentCommit, &peakCommit, &pageFaults);
+
+    stats["version"] = mi_version();
+    stats["rssBytes"] = currentRss;
+    stats["peakRssBytes"] = peakRss;
+    stats["committedBytes"] = currentCommit;
+    stats["peakCommittedBytes"] = peakCommit;
+    stats["pageFaults"] = pageFaults;
+#elif defined(__GLIBC__)
+    // __GLIBC_PREREQ only exists with glibc, so it cannot share the defined() test
+#if __GLIBC_PREREQ(2, 33)
+    struct mallinfo2 info = mallinfo2();
+    stats["arenaBytes"] = info.arena;
+    stats["mmapBytes"] = info.hblkhd;
+    stats["inUseBytes"] = info.uordblks;
+    stats["freeBytes"] = info.fordblks;
+    stats["releasableBytes"] = info.keepcost;
+    stats["freeChunks"] = info.ordblks;
+#endif
+#endif
+
+    return stats;
+}
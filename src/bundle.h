@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../libs/xxhash/xxhash.h"
+#include "perfect_hash.h"
+#include "vocabulary.h"
+
+// Single-file deployment of one language: the TorchScript model, its vocabulary as a perfect hash
+// table, the stemmer language and the input length the model was trained with, under one checksum.
+// The file is mapped and validated once; the vocabulary is used in place.
+namespace bundle {
+
+inline constexpr char MAGIC[8] = { 'B', 'T', 'T', 'B', 'N', 'D', 'L', '\0' };
+inline constexpr uint32_t VERSION = 2;
+inline constexpr size_t ALIGNMENT = 64; // Sections start on cache line boundaries
+
+// File layout: header, section table, sections
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t sectionCount;
+    uint64_t checksum; // See checksumOf
+    uint64_t wordIndexHash; // XXH64 of the word index file the vocabulary was built from
+    uint32_t maxLength; // Tokens per model input row
+    uint32_t wordCount;
+    uint32_t bucketCount;
+    uint32_t reserved;
+    char language[16]; // Stemmer language
+};
+
+enum class Section : uint32_t { Model = 1, Pilots, Offsets, Ids, Keys };
+
+struct SectionEntry {
+    uint32_t kind;
+    uint32_t reserved;
+    uint64_t offset; // From the start of the file
+    uint64_t size;
+};
+
+// Function to checksum a bundle: XXH64 of everything after the header, seeded with the XXH64 of the
+// header itself with its checksum zeroed
+inline uint64_t checksumOf(const Header& header, const char* body, size_t size) {
+    Header unsummed = header;
+    unsummed.checksum = 0;
+    return XXH64(body, size, XXH64(&unsummed, sizeof(unsummed), 0));
+}
+
+// Struct to hold what goes into a bundle
+struct Contents {
+    std::string language;
+    uint32_t maxLength = 0;
+    uint64_t wordIndexHash = 0;
+    std::string model; // TorchScript archive bytes
+    perfect_hash::Table vocabulary;
+};
+
+// Function to write a bundle; returns its size in bytes
+inline size_t write(const std::string& path, const Contents& contents) {
+    if (contents.language.size() >= sizeof(Header::language)) throw std::invalid_argument("Stemmer language name too long: " + contents.language);
+
+    std::vector<std::pair<Section, std::string_view>> sections = {
+        {Section::Model, contents.model},
+        {Section::Pilots, {reinterpret_cast<const char*>(contents.vocabulary.pilots.data()), contents.vocabulary.pilots.size() * sizeof(uint32_t)}},
+        {Section::Offsets, {reinterpret_cast<const char*>(contents.vocabulary.offsets.data()), contents.vocabulary.offsets.size() * sizeof(uint32_t)}},
+        {Section::Ids, {reinterpret_cast<const char*>(contents.vocabulary.ids.data()), contents.vocabulary.ids.size() * sizeof(int32_t)}},
+        {Section::Keys, contents.vocabulary.keys},
+    };
+
+    // Everything after the header is assembled first, as the checksum covers it too
+    std::string body(sections.size() * sizeof(SectionEntry), '\0');
+    for (size_t i = 0; i < sections.size(); i++) {
+        body.resize((sizeof(Header) + body.size() + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT - sizeof(Header), '\0');
+        SectionEntry entry{ uint32_t(sections[i].first), 0, sizeof(Header) + body.size(), sections[i].second.size() };
+        std::memcpy(body.data() + i * sizeof(SectionEntry), &entry, sizeof(entry));
+        body.append(sections[i].second);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.sectionCount = uint32_t(sections.size());
+    header.wordIndexHash = contents.wordIndexHash;
+    header.maxLength = contents.maxLength;
+    header.wordCount = uint32_t(contents.vocabulary.ids.size());
+    header.bucketCount = uint32_t(contents.vocabulary.pilots.size());
+    std::strncpy(header.language, contents.language.c_str(), sizeof(header.language) - 1);
+    header.checksum = checksumOf(header, body.data(), body.size());
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Cannot write bundle: " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(body.data(), body.size());
+    if (!out) throw std::runtime_error("Cannot write bundle: " + path);
+    return sizeof(header) + body.size();
+}
+
+// Read-only view of a bundle mapped from disk, validated when opened
+class Bundle {
+public:
+    static std::unique_ptr<Bundle> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open bundle: " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Bundle is truncated: " + path);
+        }
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("Cannot map bundle: " + path);
+        return std::unique_ptr<Bundle>(new Bundle(path, data, info.st_size));
+    }
+
+    ~Bundle() { munmap(data, size); }
+
+    Bundle(const Bundle&) = delete;
+    Bundle& operator=(const Bundle&) = delete;
+
+    const Header& header() const { return *static_cast<const Header*>(data); }
+    std::string language() const { return std::string(header().language, strnlen(header().language, sizeof(header().language))); }
+    size_t bytes() const { return size; }
+
+    std::string_view section(Section kind) const {
+        auto entries = reinterpret_cast<const SectionEntry*>(static_cast<const char*>(data) + sizeof(Header));
+        for (uint32_t i = 0; i < header().sectionCount; i++) {
+            if (entries[i].kind == uint32_t(kind)) return std::string_view(static_cast<const char*>(data) + entries[i].offset, entries[i].size);
+        }
+        throw std::runtime_error("Bundle has no section " + std::to_string(uint32_t(kind)));
+    }
+
+    // Function to view the vocabulary in place; valid while the bundle is open
+    std::unique_ptr<Vocabulary> vocabulary() const {
+        return std::make_unique<PerfectHashVocabulary>(
+            reinterpret_cast<const uint32_t*>(section(Section::Pilots).data()), header().bucketCount,
+            reinterpret_cast<const uint32_t*>(section(Section::Offsets).data()),
+            reinterpret_cast<const int32_t*>(section(Section::Ids).data()),
+            section(Section::Keys).data(), header().wordCount);
+    }
+
+private:
+    Bundle(const std::string& path, void* data, size_t size) : data(data), size(size) {
+        try {
+            validate();
+        }
+        catch (const std::runtime_error& e) {
+            munmap(data, size);
+            throw std::runtime_error(std::string(e.what()) + ": " + path);
+        }
+    }
+
+    void validate() const {
+        const Header& header = this->header();
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            throw std::runtime_error("Not a bundle of version " + std::to_string(VERSION));
+        }
+        if (header.maxLength == 0) throw std::runtime_error("Bundle has no max length");
+        if (size - sizeof(Header) < size_t(header.sectionCount) * sizeof(SectionEntry)) throw std::runtime_error("Bundle is truncated");
+        if (checksumOf(header, static_cast<const char*>(data) + sizeof(Header), size - sizeof(Header)) != header.checksum) {
+            throw std::runtime_error("Bundle checksum mismatch");
+        }
+
+        auto entries = reinterpret_cast<const SectionEntry*>(static_cast<const char*>(data) + sizeof(Header));
+        for (uint32_t i = 0; i < header.sectionCount; i++) {
+            if (entries[i].offset % ALIGNMENT != 0 || entries[i].offset > size || entries[i].size > size - entries[i].offset) {
+                throw std::runtime_error("Bundle section out of bounds");
+            }
+        }
+
+        size_t words = header.wordCount;
+        auto offsets = reinterpret_cast<const uint32_t*>(section(Section::Offsets).data());
+        if (section(Section::Pilots).size() != size_t(header.bucketCount) * sizeof(uint32_t) || header.bucketCount == 0
+            || section(Section::Offsets).size() != (words + 1) * sizeof(uint32_t)
+            || section(Section::Ids).size() != words * sizeof(int32_t)
+            || section(Section::Keys).size() != offsets[words]) {
+            throw std::runtime_error("Bundle vocabulary is inconsistent");
+        }
+        section(Section::Model);
+    }
+
+    void* data;
+    size_t size;
+};
+
+}
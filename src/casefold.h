@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "casefold_table.h"
+
+// Simple Unicode case folding of UTF-8 text, so the same word matches the vocabulary whatever its case
+namespace casefold {
+
+// Function to fold one code point through the generated range table
+inline uint32_t foldCodePoint(uint32_t cp) {
+    if (cp < 0x80) return cp >= 'A' && cp <= 'Z' ? cp + ('a' - 'A') : cp;
+
+    // Last range starting at or before cp; ranges never overlap so it is the only candidate
+    auto range = std::upper_bound(std::begin(FOLD_RANGES), std::end(FOLD_RANGES), cp,
+        [](uint32_t value, const FoldRange& entry) { return value < entry.first; });
+    if (range == std::begin(FOLD_RANGES)) return cp;
+    --range;
+    uint32_t offset = cp - range->first;
+    if (offset % range->stride != 0 || offset / range->stride >= range->count) return cp;
+    return uint32_t(int32_t(cp) + range->delta);
+}
+
+// Function to decode the code point at s; returns its length, or 0 for an invalid sequence
+inline size_t decodeUtf8(const unsigned char* s, size_t n, uint32_t& cp) {
+    size_t length;
+    uint32_t min;
+    if (s[0] < 0x80) {
+        cp = s[0];
+        return 1;
+    }
+    else if ((s[0] & 0xE0) == 0xC0) {
+        length = 2;
+        min = 0x80;
+        cp = s[0] & 0x1F;
+    }
+    else if ((s[0] & 0xF0) == 0xE0) {
+        length = 3;
+        min = 0x800;
+        cp = s[0] & 0x0F;
+    }
+    else if ((s[0] & 0xF8) == 0xF0) {
+        length = 4;
+        min = 0x10000;
+        cp = s[0] & 0x07;
+    }
+    else {
+        return 0;
+    }
+    if (n < length) return 0;
+    for (size_t i = 1; i < length; i++) {
+        if ((s[i] & 0xC0) != 0x80) return 0;
+        cp = cp << 6 | (s[i] & 0x3F);
+    }
+
+    // Reject overlong forms, surrogates and values past the last plane
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF)) return 0;
+    return length;
+}
+
+template <typename String>
+void appendUtf8(String& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out.push_back(char(cp));
+    }
+    else if (cp < 0x800) {
+        out.push_back(char(0xC0 | cp >> 6));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else if (cp < 0x10000) {
+        out.push_back(char(0xE0 | cp >> 12));
+        out.push_back(char(0x80 | (cp >> 6 & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+    else {
+        out.push_back(char(0xF0 | cp >> 18));
+        out.push_back(char(0x80 | (cp >> 12 & 0x3F)));
+        out.push_back(char(0x80 | (cp >> 6 & 0x3F)));
+        out.push_back(char(0x80 | (cp & 0x3F)));
+    }
+}
+
+// Function to case fold a UTF-8 word into out. Pure ASCII words are returned as they are, on the
+// assumption that the caller already lowered them; invalid bytes are copied through unchanged.
+template <typename String>
+std::string_view foldUtf8(std::string_view word, String& out) {
+    auto bytes = reinterpret_cast<const unsigned char*>(word.data());
+    size_t position = 0;
+    while (position < word.size() && bytes[position] < 0x80) position++;
+    if (position == word.size()) return word;
+
+    out.assign(word.substr(0, position));
+    while (position < word.size()) {
+        uint32_t cp;
+        size_t length = decodeUtf8(bytes + position, word.size() - position, cp);
+        if (length == 0) {
+            out.push_back(word[position++]);
+            continue;
+        }
+        appendUtf8(out, foldCodePoint(cp));
+        position += length;
+    }
+    return out;
+}
+
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <mutex>
+
+// Struct to hold the tunables of the adaptive concurrency limit
+struct LimiterConfig {
+    std::atomic<bool> enabled{ false }; // Off until configured, as a wrong target would reject healthy traffic
+    std::atomic<double> targetLatencyMs{ 250 };
+    std::atomic<int> initialLimit{ 16 };
+    std::atomic<int> minLimit{ 1 };
+    std::atomic<int> maxLimit{ 512 };
+    std::atomic<double> backoffRatio{ 0.9 };
+    std::atomic<int> windowMs{ 100 };
+};
+
+// Concurrency limit adjusted by AIMD on measured latency: each window whose mean latency exceeds
+// the target shrinks the limit multiplicatively, each window that met the target while saturated
+// grows it by one. It converges on the highest concurrency the target latency allows.
+class AdaptiveLimiter {
+public:
+    explicit AdaptiveLimiter(const LimiterConfig& config) : config(config), windowStart(nowNs()) {}
+
+    // Function to admit a request if the limit allows it
+    bool tryAcquire() {
+        if (!config.enabled.load(std::memory_order_relaxed)) {
+            inFlight.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        int64_t limit = currentLimit();
+        int64_t current = inFlight.load(std::memory_order_relaxed);
+        do {
+            if (current >= limit) return false;
+        } while (!inFlight.compare_exchange_weak(current, current + 1, std::memory_order_relaxed));
+
+        int64_t peak = windowPeak.load(std::memory_order_relaxed);
+        while (current + 1 > peak && !windowPeak.compare_exchange_weak(peak, current + 1, std::memory_order_relaxed)) {}
+        return true;
+    }
+
+    // Function to release an admitted request, feeding its latency back into the limit
+    void release(std::chrono::nanoseconds latency) {
+        inFlight.fetch_sub(1, std::memory_order_relaxed);
+
+        // While off, nothing is measured: tryAcquire does not track the peak, so the limit could only
+        // shrink. Turning it on starts over from the initial limit with a fresh window.
+        if (!config.enabled.load(std::memory_order_relaxed)) {
+            if (measuring.load(std::memory_order_relaxed) && measuring.exchange(false, std::memory_order_relaxed)) {
+                limit.store(0, std::memory_order_relaxed);
+            }
+            return;
+        }
+        int64_t now = nowNs();
+        if (!measuring.load(std::memory_order_relaxed) && !measuring.exchange(true, std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(adjustMutex);
+            windowStart.store(now, std::memory_order_relaxed);
+            windowLatencyNs.store(0, std::memory_order_relaxed);
+            windowSamples.store(0, std::memory_order_relaxed);
+            windowPeak.store(inFlight.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return;
+        }
+
+        windowLatencyNs.fetch_add(latency.count(), std::memory_order_relaxed);
+        windowSamples.fetch_add(1, std::memory_order_relaxed);
+
+        int64_t windowNs = int64_t(config.windowMs.load(std::memory_order_relaxed)) * 1000000;
+        if (now - windowStart.load(std::memory_order_relaxed) < windowNs) return;
+
+        std::unique_lock<std::mutex> lock(adjustMutex, std::try_to_lock);
+        if (!lock.owns_lock() || now - windowStart.load(std::memory_order_relaxed) < windowNs) return;
+        windowStart.store(now, std::memory_order_relaxed);
+        adjust();
+    }
+
+    // Function to release an admitted request that never reached inference
+    void cancel() {
+        inFlight.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    int64_t currentLimit() const {
+        int64_t value = limit.load(std::memory_order_relaxed);
+        return value > 0 ? value : config.initialLimit.load(std::memory_order_relaxed);
+    }
+
+    int64_t currentInFlight() const { return inFlight.load(std::memory_order_relaxed); }
+
+private:
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void adjust() {
+        int64_t samples = windowSamples.exchange(0, std::memory_order_relaxed);
+        int64_t latencyNs = windowLatencyNs.exchange(0, std::memory_order_relaxed);
+        int64_t peak = windowPeak.exchange(inFlight.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        if (samples == 0) return;
+
+        double meanLatencyMs = double(latencyNs) / samples / 1e6;
+        int64_t previous = currentLimit();
+        int64_t next = previous;
+        if (meanLatencyMs > config.targetLatencyMs.load(std::memory_order_relaxed)) {
+            next = int64_t(std::floor(previous * config.backoffRatio.load(std::memory_order_relaxed)));
+        }
+        else if (peak >= previous) {
+            next = previous + 1;
+        }
+
+        int64_t minLimit = std::max(1, config.minLimit.load(std::memory_order_relaxed));
+        int64_t maxLimit = std::max<int64_t>(minLimit, config.maxLimit.load(std::memory_order_relaxed));
+        limit.store(std::clamp(next, minLimit, maxLimit), std::memory_order_relaxed);
+    }
+
+    const LimiterConfig& config;
+    std::atomic<int64_t> limit{ 0 };
+    std::atomic<int64_t> inFlight{ 0 };
+    std::atomic<bool> measuring{ false }; // Whether the last release found the limit on; the first one that does opens a window
+    std::atomic<int64_t> windowStart;
+    std::atomic<int64_t> windowLatencyNs{ 0 };
+    std::atomic<int64_t> windowSamples{ 0 };
+    std::atomic<int64_t> windowPeak{ 0 };
+    std::mutex adjustMutex;
+};
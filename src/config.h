@@ -0,0 +1,183 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../libs/nlohmann/json.hpp"
+#include "../libs/cxxopts/cxxopts.hpp"
+
+// Struct to describe one tunable bound to the variable that holds it
+struct Setting {
+    std::string name;
+    bool live; // Safe to change while serving
+    std::string source = "default";
+    std::function<nlohmann::json()> get;
+    std::function<void(const nlohmann::json&)> set;
+    std::function<void(const cxxopts::ParseResult&)> setFromCli;
+};
+
+// Class to declare tunables once for both the command line and the configuration file.
+// Plain variables are read at startup only; atomic variables are live and follow reloads.
+class Settings {
+public:
+    explicit Settings(cxxopts::Options& options) : options(options) {}
+
+    template <typename T>
+    void add(const std::string& flags, const std::string& description, T& field) {
+        std::string name = nameOf(flags);
+        options.add_options()(flags, description, valueOf(field));
+        settings.push_back(Setting{
+            name, false, "default",
+            [&field] { return nlohmann::json(field); },
+            [&field](const nlohmann::json& value) { field = value.get<T>(); },
+            [&field, name](const cxxopts::ParseResult& result) { field = result[name].as<T>(); }
+        });
+    }
+
+    template <typename T>
+    void add(const std::string& flags, const std::string& description, std::atomic<T>& field) {
+        std::string name = nameOf(flags);
+        options.add_options()(flags, description + " (live)", valueOf(field.load()));
+        settings.push_back(Setting{
+            name, true, "default",
+            [&field] { return nlohmann::json(field.load()); },
+            [&field](const nlohmann::json& value) { field.store(value.get<T>()); },
+            [&field, name](const cxxopts::ParseResult& result) { field.store(result[name].as<T>()); }
+        });
+    }
+
+    template <typename T>
+    void add(const std::string& flags, const std::string& description, std::atomic<std::shared_ptr<const T>>& field) {
+        std::string name = nameOf(flags);
+        options.add_options()(flags, description + " as JSON (live)", cxxopts::value<std::string>());
+        settings.push_back(Setting{
+            name, true, "default",
+            [&field] { return nlohmann::json(*field.load()); },
+            [&field](const nlohmann::json& value) { field.store(std::make_shared<const T>(value.get<T>())); },
+            [&field, name](const cxxopts::ParseResult& result) {
+                field.store(std::make_shared<const T>(nlohmann::json::parse(result[name].as<std::string>()).get<T>()));
+            }
+        });
+    }
+
+    // Function to add a static setting of a structured type, given as JSON on the command line
+    template <typename T>
+    void addJson(const std::string& flags, const std::string& description, T& field) {
+        std::string name = nameOf(flags);
+        options.add_options()(flags, description + " as JSON", cxxopts::value<std::string>());
+        settings.push_back(Setting{
+            name, false, "default",
+            [&field] { return nlohmann::json(field); },
+            [&field](const nlohmann::json& value) { field = value.get<T>(); },
+            [&field, name](const cxxopts::ParseResult& result) {
+                field = nlohmann::json::parse(result[name].as<std::string>()).get<T>();
+            }
+        });
+    }
+
+    // Function to apply the options given explicitly on the command line; they win over the file
+    void applyCli(const cxxopts::ParseResult& result) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& setting : settings) {
+            if (result.count(setting.name) == 0) continue;
+            setting.setFromCli(result);
+            setting.source = "cli";
+        }
+    }
+
+    // Function to apply a JSON configuration file. At startup every key is applied; on reload only
+    // live keys are, and the names of the settings that changed are returned.
+    std::vector<std::string> applyFile(const std::string& path, bool reload) {
+        std::ifstream file(path);
+        if (!file) throw std::runtime_error("Cannot open configuration file: " + path);
+        nlohmann::json config = nlohmann::json::parse(file);
+        if (!config.is_object()) throw std::runtime_error("Configuration file must hold a JSON object: " + path);
+
+        std::lock_guard<std::mutex> lock(mutex);
+
+        // Validate everything before changing anything, so a bad file is rejected as a whole
+        std::vector<std::pair<Setting*, const nlohmann::json*>> updates;
+        for (const auto& [name, value] : config.items()) {
+            Setting* setting = find(name);
+            if (!setting) throw std::runtime_error("Unknown configuration key: " + name);
+            if (setting->source == "cli") continue;
+            if (setting->get() == value) continue;
+            if (reload && !setting->live) {
+                std::cerr << "Configuration key " << name << " changed but only takes effect after a restart" << std::endl;
+                continue;
+            }
+            updates.emplace_back(setting, &value);
+        }
+
+        std::vector<nlohmann::json> previous;
+        for (auto& [setting, value] : updates) previous.push_back(setting->get());
+        try {
+            for (auto& [setting, value] : updates) setting->set(*value);
+        }
+        catch (const nlohmann::json::exception&) {
+            for (size_t i = 0; i < previous.size(); i++) updates[i].first->set(previous[i]);
+            throw;
+        }
+
+        std::vector<std::string> changed;
+        for (auto& [setting, value] : updates) {
+            setting->source = "file";
+            changed.push_back(setting->name);
+        }
+        return changed;
+    }
+
+    // Function to describe the effective configuration
+    nlohmann::json toJson() {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto json = nlohmann::json::object();
+        for (const auto& setting : settings) {
+            json[setting.name] = {
+                {"value", setting.get()},
+                {"live", setting.live},
+                {"source", setting.source}
+            };
+        }
+        return json;
+    }
+
+private:
+    static std::string nameOf(const std::string& flags) {
+        auto comma = flags.find(',');
+        return comma == std::string::npos ? flags : flags.substr(comma + 1);
+    }
+
+    template <typename T>
+    static std::shared_ptr<cxxopts::Value> valueOf(const T& defaultValue) {
+        if constexpr (std::is_same_v<T, std::string>) {
+            return cxxopts::value<T>()->default_value(defaultValue);
+        }
+        else if constexpr (std::is_same_v<T, bool>) {
+            return cxxopts::value<T>()->default_value(defaultValue ? "true" : "false");
+        }
+        else if constexpr (std::is_arithmetic_v<T>) {
+            return cxxopts::value<T>()->default_value(nlohmann::json(defaultValue).dump());
+        }
+        else {
+            return cxxopts::value<T>();
+        }
+    }
+
+    Setting* find(const std::string& name) {
+        for (auto& setting : settings) {
+            if (setting.name == name) return &setting;
+        }
+        return nullptr;
+    }
+
+    cxxopts::Options& options;
+    std::vector<Setting> settings;
+    std::mutex mutex;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <memory>
+#include "vocabulary.h"
+#include "embedded_vocabulary_data.h" // Generated by tools/gen_vocabulary at build time
+
+// Word index compiled into the binary as a minimal perfect hash table, so nothing is read or
+// parsed at startup
+inline std::unique_ptr<Vocabulary> embeddedVocabulary() {
+    return std::make_unique<PerfectHashVocabulary>(embedded_vocabulary::PILOTS, embedded_vocabulary::BUCKET_COUNT,
+        embedded_vocabulary::OFFSETS, embedded_vocabulary::IDS, reinterpret_cast<const char*>(embedded_vocabulary::KEYS),
+        embedded_vocabulary::WORD_COUNT);
+}
+
+// XXH64 of the word index file the table was generated from, which a word FST must match
+inline constexpr uint64_t EMBEDDED_WORD_INDEX_HASH = embedded_vocabulary::WORD_INDEX_HASH;
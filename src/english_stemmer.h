@@ -0,0 +1,298 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+// Native implementation of the Snowball English (Porter2) stemmer, producing the same stems as
+// libstemmer's "english" algorithm for ASCII words. Stemming never lengthens a word, so it runs in
+// place on a buffer of the input's size.
+class EnglishStemmer {
+public:
+    // Function to tell whether a word can be stemmed natively; others go through libstemmer
+    static bool supports(std::string_view word) {
+        for (char c : word) {
+            if (static_cast<unsigned char>(c) >= 0x80) return false;
+        }
+        return true;
+    }
+
+    // Function to stem word into out, which must hold word.size() bytes; returns the stem length
+    static size_t stem(std::string_view word, char* out) {
+        std::memmove(out, word.data(), word.size());
+        EnglishStemmer stemmer(out, word.size());
+        stemmer.run();
+        return stemmer.n;
+    }
+
+private:
+    EnglishStemmer(char* s, size_t n) : s(s), n(n) {}
+
+    static bool isVowel(char c) {
+        return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u' || c == 'y';
+    }
+
+    static bool isVowelWXY(char c) {
+        return isVowel(c) || c == 'w' || c == 'x' || c == 'Y';
+    }
+
+    static bool isValidLI(char c) {
+        return c != '\0' && std::strchr("cdeghkmnrt", c) != nullptr;
+    }
+
+    static bool isDoubled(char c) {
+        return c != '\0' && std::strchr("bdfgmnprt", c) != nullptr;
+    }
+
+    bool endsWith(std::string_view suffix) const {
+        return n >= suffix.size() && std::memcmp(s + n - suffix.size(), suffix.data(), suffix.size()) == 0;
+    }
+
+    bool equals(std::string_view word) const {
+        return n == word.size() && std::memcmp(s, word.data(), n) == 0;
+    }
+
+    void replaceSuffix(size_t length, std::string_view replacement) {
+        n -= length;
+        std::memcpy(s + n, replacement.data(), replacement.size());
+        n += replacement.size();
+    }
+
+    bool hasVowelBefore(size_t end) const {
+        for (size_t i = 0; i < end; i++) {
+            if (isVowel(s[i])) return true;
+        }
+        return false;
+    }
+
+    // Whether the word up to end finishes with a short syllable
+    bool shortSyllable(size_t end) const {
+        if (end >= 3 && !isVowelWXY(s[end - 1]) && isVowel(s[end - 2]) && !isVowel(s[end - 3])) return true;
+        return end == 2 && !isVowel(s[1]) && isVowel(s[0]);
+    }
+
+    // Suffix rule of a step: suffixes of a step are listed longest first, so the first one that
+    // matches is the longest, which is the only one Snowball considers
+    struct Rule {
+        std::string_view suffix;
+        std::string_view replacement;
+    };
+
+    template <size_t Count>
+    const Rule* longestSuffix(const Rule (&rules)[Count]) const {
+        if (n == 0) return nullptr;
+        char last = s[n - 1];
+
+        for (const Rule& rule : rules) {
+            if (rule.suffix.back() == last && endsWith(rule.suffix)) return &rule;
+        }
+        return nullptr;
+    }
+
+    void run() {
+        if (exception1() || n < 3) return;
+
+        prelude();
+        markRegions();
+        step1a();
+        if (!exception2()) {
+            step1b();
+            step1c();
+            step2();
+            step3();
+            step4();
+            step5();
+        }
+        postlude();
+    }
+
+    bool exception1() {
+        if (n < 3 || n > 6) return false;
+        static const Rule exceptions[] = {
+            {"skis", "ski"}, {"skies", "sky"}, {"dying", "die"}, {"lying", "lie"}, {"tying", "tie"},
+            {"idly", "idl"}, {"gently", "gentl"}, {"ugly", "ugli"}, {"early", "earli"}, {"only", "onli"},
+            {"singly", "singl"}, {"sky", "sky"}, {"news", "news"}, {"howe", "howe"}, {"atlas", "atlas"},
+            {"cosmos", "cosmos"}, {"bias", "bias"}, {"andes", "andes"},
+        };
+        for (const Rule& exception : exceptions) {
+            if (exception.suffix[0] == s[0] && equals(exception.suffix)) {
+                replaceSuffix(n, exception.replacement);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool exception2() const {
+        if (n < 6 || n > 7) return false;
+        static const std::string_view invariants[] = {
+            "inning", "outing", "canning", "herring", "earring", "proceed", "exceed", "succeed",
+        };
+        for (std::string_view invariant : invariants) {
+            if (equals(invariant)) return true;
+        }
+        return false;
+    }
+
+    void prelude() {
+        if (s[0] == '\'') {
+            std::memmove(s, s + 1, --n);
+        }
+        if (n > 0 && s[0] == 'y') {
+            s[0] = 'Y';
+            yFound = true;
+        }
+        for (size_t i = 1; i < n; i++) {
+            if (s[i] == 'y' && isVowel(s[i - 1])) {
+                s[i] = 'Y';
+                yFound = true;
+            }
+        }
+    }
+
+    // Function to find the end of the first vowel-consonant pair at or after begin, or n
+    size_t pastVowelConsonant(size_t begin) const {
+        size_t i = begin;
+        while (i < n && !isVowel(s[i])) i++;
+        while (i < n && isVowel(s[i])) i++;
+        return i < n ? i + 1 : n;
+    }
+
+    void markRegions() {
+        p1 = n;
+        if (equalsPrefix("gener") || equalsPrefix("arsen")) p1 = 5;
+        else if (equalsPrefix("commun")) p1 = 6;
+        else p1 = pastVowelConsonant(0);
+        p2 = pastVowelConsonant(p1);
+    }
+
+    bool equalsPrefix(std::string_view prefix) const {
+        return n >= prefix.size() && std::memcmp(s, prefix.data(), prefix.size()) == 0;
+    }
+
+    void step1a() {
+        if (endsWith("'s'")) n -= 3;
+        else if (endsWith("'s")) n -= 2;
+        else if (endsWith("'")) n -= 1;
+
+        if (endsWith("sses")) {
+            n -= 2;
+        }
+        else if (endsWith("ied") || endsWith("ies")) {
+            replaceSuffix(3, n > 4 ? "i" : "ie");
+        }
+        else if (endsWith("us") || endsWith("ss")) {
+        }
+        else if (endsWith("s")) {
+            // Delete if a vowel precedes the letter before the s
+            if (n >= 2 && hasVowelBefore(n - 2)) n--;
+        }
+    }
+
+    void step1b() {
+        static const Rule rules[] = {
+            {"eedly", "ee"}, {"ingly", ""}, {"edly", ""}, {"eed", "ee"}, {"ing", ""}, {"ed", ""},
+        };
+        const Rule* rule = longestSuffix(rules);
+        if (!rule) return;
+
+        size_t begin = n - rule->suffix.size();
+        if (!rule->replacement.empty()) {
+            if (begin >= p1) replaceSuffix(rule->suffix.size(), rule->replacement);
+            return;
+        }
+        if (!hasVowelBefore(begin)) return;
+
+        n = begin;
+        if (endsWith("at") || endsWith("bl") || endsWith("iz")) {
+            s[n++] = 'e';
+        }
+        else if (n >= 2 && s[n - 1] == s[n - 2] && isDoubled(s[n - 1])) {
+            n--;
+        }
+        else if (n == p1 && shortSyllable(n)) {
+            s[n++] = 'e';
+        }
+    }
+
+    void step1c() {
+        if (n >= 3 && (s[n - 1] == 'y' || s[n - 1] == 'Y') && !isVowel(s[n - 2])) s[n - 1] = 'i';
+    }
+
+    void step2() {
+        static const Rule rules[] = {
+            {"ational", "ate"}, {"fulness", "ful"}, {"iveness", "ive"}, {"ization", "ize"}, {"ousness", "ous"},
+            {"tional", "tion"}, {"biliti", "ble"}, {"lessli", "less"},
+            {"entli", "ent"}, {"ation", "ate"}, {"alism", "al"}, {"aliti", "al"}, {"ousli", "ous"},
+            {"iviti", "ive"}, {"fulli", "ful"},
+            {"enci", "ence"}, {"anci", "ance"}, {"abli", "able"}, {"izer", "ize"}, {"ator", "ate"}, {"alli", "al"},
+            {"bli", "ble"}, {"ogi", "og"},
+            {"li", ""},
+        };
+        const Rule* rule = longestSuffix(rules);
+        if (!rule) return;
+
+        size_t begin = n - rule->suffix.size();
+        if (begin < p1) return;
+        if (rule->suffix == "ogi" && (begin == 0 || s[begin - 1] != 'l')) return;
+        if (rule->suffix == "li" && (begin == 0 || !isValidLI(s[begin - 1]))) return;
+        replaceSuffix(rule->suffix.size(), rule->replacement);
+    }
+
+    void step3() {
+        static const Rule rules[] = {
+            {"ational", "ate"}, {"tional", "tion"},
+            {"alize", "al"}, {"icate", "ic"}, {"iciti", "ic"}, {"ative", ""},
+            {"ical", "ic"}, {"ness", ""},
+            {"ful", ""},
+        };
+        const Rule* rule = longestSuffix(rules);
+        if (!rule) return;
+
+        size_t begin = n - rule->suffix.size();
+        if (begin < p1) return;
+        if (rule->suffix == "ative" && begin < p2) return;
+        replaceSuffix(rule->suffix.size(), rule->replacement);
+    }
+
+    void step4() {
+        static const Rule rules[] = {
+            {"ement", ""},
+            {"ance", ""}, {"ence", ""}, {"able", ""}, {"ible", ""}, {"ment", ""},
+            {"ant", ""}, {"ent", ""}, {"ism", ""}, {"ate", ""}, {"iti", ""}, {"ous", ""}, {"ive", ""}, {"ize", ""},
+            {"ion", ""},
+            {"al", ""}, {"er", ""}, {"ic", ""},
+        };
+        const Rule* rule = longestSuffix(rules);
+        if (!rule) return;
+
+        size_t begin = n - rule->suffix.size();
+        if (begin < p2) return;
+        if (rule->suffix == "ion" && (begin == 0 || (s[begin - 1] != 's' && s[begin - 1] != 't'))) return;
+        n = begin;
+    }
+
+    void step5() {
+        if (endsWith("e")) {
+            size_t begin = n - 1;
+            if (begin >= p2 || (begin >= p1 && !shortSyllable(begin))) n--;
+        }
+        else if (endsWith("l")) {
+            size_t begin = n - 1;
+            if (begin >= p2 && begin > 0 && s[begin - 1] == 'l') n--;
+        }
+    }
+
+    void postlude() {
+        if (!yFound) return;
+        for (size_t i = 0; i < n; i++) {
+            if (s[i] == 'Y') s[i] = 'y';
+        }
+    }
+
+    char* s;
+    size_t n;
+    size_t p1 = 0;
+    size_t p2 = 0;
+    bool yFound = false;
+};
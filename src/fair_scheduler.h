@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Struct to hold the tunables of the scheduler in front of the model
+struct SchedulerConfig {
+    int threads = 2;
+    std::atomic<int> batchSize{ 1 }; // Raise it for models accepting batches
+    std::atomic<int> batchWaitUs{ 0 };
+    std::atomic<int> maxQueuePerClient{ 64 };
+    std::atomic<std::shared_ptr<const std::map<std::string, double>>> clientWeights{
+        std::make_shared<const std::map<std::string, double>>()
+    };
+};
+
+// Scheduler that forms inference batches from per-client queues by deficit round-robin, so a
+// client's share of the model follows its weight no matter how much the others submit
+template <typename Job>
+class FairScheduler {
+public:
+    using BatchHandler = std::function<void(std::vector<Job*>&)>;
+
+    FairScheduler(const SchedulerConfig& config, BatchHandler handler) : config(config), handler(std::move(handler)) {}
+
+    ~FairScheduler() { stop(); }
+
+    void start() {
+        for (int i = 0; i < std::max(1, config.threads); i++) {
+            workers.emplace_back([this] { work(); });
+        }
+    }
+
+    // Function to stop the workers once everything already queued has run
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        available.notify_all();
+        for (auto& worker : workers) worker.join();
+        workers.clear();
+    }
+
+    // Function to queue a job; false when the client already has too many jobs waiting
+    bool submit(const std::string& client, Job* job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto [entry, inserted] = clients.try_emplace(client);
+            ClientQueue& queue = entry->second;
+            if (queue.jobs.size() >= size_t(std::max(1, config.maxQueuePerClient.load(std::memory_order_relaxed)))) {
+                return false;
+            }
+            if (inserted) active.push_back(entry);
+            queue.jobs.push_back(job);
+            queued++;
+        }
+        available.notify_one();
+        return true;
+    }
+
+    size_t queuedJobs() const { return queued.load(std::memory_order_relaxed); }
+
+private:
+    struct ClientQueue {
+        std::deque<Job*> jobs;
+        double deficit = 0;
+    };
+
+    // Iterators into clients, which stay valid while other clients come and go
+    using ClientEntry = typename std::map<std::string, ClientQueue>::iterator;
+
+    void work() {
+        std::vector<Job*> batch;
+        while (true) {
+            batch.clear();
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                available.wait(lock, [this] { return stopping || queued > 0; });
+                if (queued == 0) return;
+
+                size_t batchSize = size_t(std::max(1, config.batchSize.load(std::memory_order_relaxed)));
+                fill(batch, batchSize);
+
+                // Give other requests a moment to join a partial batch
+                auto wait = std::chrono::microseconds(config.batchWaitUs.load(std::memory_order_relaxed));
+                if (batch.size() < batchSize && wait.count() > 0) {
+                    auto deadline = std::chrono::steady_clock::now() + wait;
+                    while (batch.size() < batchSize && !stopping) {
+                        if (!available.wait_until(lock, deadline, [this] { return stopping || queued > 0; })) break;
+                        fill(batch, batchSize);
+                    }
+                }
+            }
+            if (queued > 0) available.notify_one();
+            handler(batch);
+        }
+    }
+
+    // Function to move jobs into the batch in deficit round-robin order; called with the lock held
+    void fill(std::vector<Job*>& batch, size_t batchSize) {
+        auto weights = config.clientWeights.load(std::memory_order_relaxed);
+        while (batch.size() < batchSize && !active.empty()) {
+            ClientEntry entry = active.front();
+            ClientQueue& queue = entry->second;
+
+            if (queue.deficit < 1) {
+                auto weight = weights->find(entry->first);
+                queue.deficit += weight == weights->end() ? 1.0 : std::max(0.01, weight->second);
+            }
+            while (queue.deficit >= 1 && !queue.jobs.empty() && batch.size() < batchSize) {
+                batch.push_back(queue.jobs.front());
+                queue.jobs.pop_front();
+                queue.deficit -= 1;
+                queued--;
+            }
+
+            active.pop_front();
+            if (queue.jobs.empty()) {
+                clients.erase(entry);
+            }
+            else if (queue.deficit < 1) {
+                active.push_back(entry);
+            }
+            else {
+                // The batch filled up before the client used its quantum; it goes first next time
+                active.push_front(entry);
+                break;
+            }
+        }
+    }
+
+    const SchedulerConfig& config;
+    BatchHandler handler;
+    std::mutex mutex;
+    std::condition_variable available;
+    std::map<std::string, ClientQueue> clients; // Only clients with queued jobs
+    std::deque<ClientEntry> active;
+    std::atomic<size_t> queued{ 0 };
+    bool stopping = false;
+    std::vector<std::thread> workers;
+};
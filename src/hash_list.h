@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "../libs/xxhash/xxhash.h"
+
+// Set of text hashes read from a list file: one text per line, or "xxh64:" and the 16 hex digits of
+// the XXH64 hash of a text that is not kept. Lookups go through a blocked Bloom filter first, so the
+// common miss costs one cache line; its hits are confirmed against the sorted hashes, so a listed
+// verdict is never given to an unlisted text.
+class HashList {
+public:
+    static constexpr uint32_t BITS_PER_HASH = 16; // About 0.1% false positives reach the exact check
+    static constexpr uint32_t PROBES = 6; // Bits set per hash, 9 hash bits each
+
+    struct alignas(64) Block {
+        uint64_t words[8];
+    };
+
+    // Function to read a list file
+    static std::shared_ptr<const HashList> load(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Cannot open hash list: " + path);
+        auto list = std::make_shared<HashList>();
+        list->filePath = path;
+        for (std::string line; std::getline(in, line);) {
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line.empty()) continue;
+            if (line.rfind("xxh64:", 0) == 0) {
+                uint64_t hash = 0;
+                auto digits = std::string_view(line).substr(6);
+                auto [end, error] = std::from_chars(digits.data(), digits.data() + digits.size(), hash, 16);
+                if (error != std::errc() || end != digits.data() + digits.size()) throw std::runtime_error("Invalid hash in " + path + ": " + line);
+                list->hashes.push_back(hash);
+            }
+            else {
+                list->hashes.push_back(XXH64(line.data(), line.size(), 0));
+            }
+        }
+        std::sort(list->hashes.begin(), list->hashes.end());
+        list->hashes.erase(std::unique(list->hashes.begin(), list->hashes.end()), list->hashes.end());
+
+        list->blocks.assign(std::max<size_t>(1, list->hashes.size() * BITS_PER_HASH / 512), Block{});
+        for (uint64_t hash : list->hashes) {
+            Block& block = list->blocks[list->blockOf(hash)];
+            uint64_t bits = mix(hash);
+            for (uint32_t i = 0; i < PROBES; i++, bits >>= 9) block.words[(bits >> 6) & 7] |= 1ull << (bits & 63);
+        }
+        return list;
+    }
+
+    bool contains(uint64_t hash) const {
+        const Block& block = blocks[blockOf(hash)];
+        uint64_t bits = mix(hash);
+        for (uint32_t i = 0; i < PROBES; i++, bits >>= 9) {
+            if (!(block.words[(bits >> 6) & 7] & (1ull << (bits & 63)))) return false;
+        }
+        return std::binary_search(hashes.begin(), hashes.end(), hash);
+    }
+
+    size_t size() const { return hashes.size(); }
+    size_t bytes() const { return blocks.size() * sizeof(Block) + hashes.size() * sizeof(uint64_t); }
+    const std::string& path() const { return filePath; }
+
+private:
+    // The block comes from the high bits of the hash, the probed bits from a remix of all of it
+    size_t blockOf(uint64_t hash) const {
+        return size_t((hash >> 32) * blocks.size() >> 32);
+    }
+
+    static uint64_t mix(uint64_t hash) {
+        hash ^= hash >> 33;
+        hash *= 0xFF51AFD7ED558CCDull;
+        return hash ^ (hash >> 33);
+    }
+
+    std::string filePath;
+    std::vector<Block> blocks;
+    std::vector<uint64_t> hashes; // Sorted
+};
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../libs/xxhash/xxhash.h"
+
+// Consistent hash ring: every node is placed at many pseudo-random points, and a key belongs to the
+// node of the first point at or after its hash. Adding or removing a node only moves the keys of
+// its own arcs, and the points even out how many keys each node gets.
+class HashRing {
+public:
+    HashRing(const std::vector<std::string>& nodes, uint32_t pointsPerNode) : nodes(nodes) {
+        if (nodes.empty()) throw std::invalid_argument("Hash ring needs at least one node");
+        for (uint32_t node = 0; node < nodes.size(); node++) {
+            // Points depend on the node's name only, so every instance builds the same ring
+            // whatever order its node list is in
+            for (uint64_t point = 0; point < std::max(1u, pointsPerNode); point++) {
+                uint64_t seed = XXH64(nodes[node].data(), nodes[node].size(), 0);
+                points.emplace_back(XXH64(&point, sizeof(point), seed), node);
+            }
+        }
+        std::sort(points.begin(), points.end());
+    }
+
+    // Function to find the index of the node owning a hash
+    uint32_t owner(uint64_t hash) const {
+        auto point = std::lower_bound(points.begin(), points.end(), std::make_pair(hash, uint32_t(0)));
+        return point == points.end() ? points.front().second : point->second;
+    }
+
+    const std::string& node(uint32_t index) const { return nodes[index]; }
+    size_t size() const { return nodes.size(); }
+
+private:
+    std::vector<std::string> nodes;
+    std::vector<std::pair<uint64_t, uint32_t>> points; // Sorted by position on the ring
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "casefold.h"
+
+// Cheap language identification from character statistics: each letter of a text votes for the
+// loaded languages whose script or orthography it belongs to, split evenly between them, so only
+// letters that tell the candidates apart decide. Plain ASCII leans towards Latin-script languages.
+class LanguageDetector {
+public:
+    explicit LanguageDetector(const std::vector<std::string>& languages) : latin(languages.size(), false) {
+        for (size_t index = 0; index < languages.size(); index++) {
+            const Signature* signature = find(languages[index]);
+            if (!signature) continue;
+            if (signature->scriptFirst == 0) {
+                latin[index] = true;
+            }
+            else {
+                scripts.push_back({ signature->scriptFirst, signature->scriptLast, index });
+            }
+
+            std::string_view letters = signature->letters;
+            while (!letters.empty()) {
+                uint32_t cp;
+                size_t length = casefold::decodeUtf8(reinterpret_cast<const unsigned char*>(letters.data()), letters.size(), cp);
+                letterVotes[cp].push_back(index);
+                letters.remove_prefix(length == 0 ? 1 : length);
+            }
+        }
+    }
+
+    // Function to pick the index of the most likely language; the first one when nothing points elsewhere
+    size_t detect(std::string_view text) const {
+        std::vector<double> scores(latin.size(), 0);
+        auto bytes = reinterpret_cast<const unsigned char*>(text.data());
+        size_t asciiLetters = 0;
+
+        for (size_t position = 0; position < text.size();) {
+            if (bytes[position] < 0x80) {
+                unsigned char c = bytes[position++];
+                asciiLetters += (c | 0x20) >= 'a' && (c | 0x20) <= 'z';
+                continue;
+            }
+            uint32_t cp;
+            size_t length = casefold::decodeUtf8(bytes + position, text.size() - position, cp);
+            position += length == 0 ? 1 : length;
+            if (length == 0) continue;
+            cp = casefold::foldCodePoint(cp);
+
+            vote(scores, letterVotes, cp);
+            size_t inScript = 0;
+            for (const auto& script : scripts) inScript += cp >= script.first && cp <= script.last;
+            for (const auto& script : scripts) {
+                if (cp >= script.first && cp <= script.last) scores[script.language] += 1.0 / inScript;
+            }
+        }
+
+        // ASCII letters only break ties between otherwise equal candidates
+        for (size_t index = 0; index < latin.size(); index++) {
+            if (latin[index]) scores[index] += asciiLetters * 1e-3;
+        }
+
+        size_t best = 0;
+        for (size_t index = 1; index < scores.size(); index++) {
+            if (scores[index] > scores[best]) best = index;
+        }
+        return best;
+    }
+
+private:
+    // Struct to describe how a language is written: the letter range of its script (0 for Latin)
+    // and the letters that set it apart from languages sharing that script
+    struct Signature {
+        const char* names; // libstemmer name and ISO codes, space separated
+        uint32_t scriptFirst;
+        uint32_t scriptLast;
+        const char* letters;
+    };
+
+    static const Signature* find(const std::string& language) {
+        static const Signature signatures[] = {
+            {"arabic ar ara", 0x0600, 0x06FF, ""},
+            {"armenian hy hye arm", 0x0530, 0x058F, ""},
+            {"basque eu eus baq", 0, 0, "ñ"},
+            {"catalan ca cat", 0, 0, "àçèéíïòóúü·"},
+            {"danish da dan", 0, 0, "æøå"},
+            {"dutch nl dut nld", 0, 0, "ëïéĳ"},
+            {"english en eng porter", 0, 0, ""},
+            {"finnish fi fin", 0, 0, "äö"},
+            {"french fr fre fra", 0, 0, "éèêëàâçîïôœùûÿ"},
+            {"german de ger deu", 0, 0, "äöüß"},
+            {"greek el gre ell", 0x0370, 0x03FF, ""},
+            {"hindi hi hin", 0x0900, 0x097F, ""},
+            {"hungarian hu hun", 0, 0, "őűáéíóöúü"},
+            {"indonesian id ind", 0, 0, ""},
+            {"irish ga gle", 0, 0, "áéíóú"},
+            {"italian it ita", 0, 0, "àèéìòù"},
+            {"lithuanian lt lit", 0, 0, "ąčęėįšųūž"},
+            {"nepali ne nep", 0x0900, 0x097F, ""},
+            {"norwegian no nor", 0, 0, "æøå"},
+            {"portuguese pt por", 0, 0, "ãõçáâêéíóôú"},
+            {"romanian ro rum ron", 0, 0, "ăâîșțşţ"},
+            {"russian ru rus", 0x0400, 0x04FF, "ыэъё"},
+            {"serbian sr srp", 0x0400, 0x04FF, "ђјљњћџ"},
+            {"spanish es esl spa", 0, 0, "ñáéíóú¿¡"},
+            {"swedish sv swe", 0, 0, "åäö"},
+            {"tamil ta tam", 0x0B80, 0x0BFF, ""},
+            {"turkish tr tur", 0, 0, "çğıöşü"},
+            {"yiddish yi yid", 0x0590, 0x05FF, ""},
+        };
+        for (const auto& signature : signatures) {
+            std::istringstream names(signature.names);
+            for (std::string name; names >> name;) {
+                if (name == language) return &signature;
+            }
+        }
+        return nullptr;
+    }
+
+    static void vote(std::vector<double>& scores, const std::unordered_map<uint32_t, std::vector<size_t>>& votes, uint32_t cp) {
+        auto entry = votes.find(cp);
+        if (entry == votes.end()) return;
+        for (size_t index : entry->second) scores[index] += 1.0 / entry->second.size();
+    }
+
+    struct Script {
+        uint32_t first;
+        uint32_t last;
+        size_t language;
+    };
+
+    std::vector<bool> latin;
+    std::vector<Script> scripts;
+    std::unordered_map<uint32_t, std::vector<size_t>> letterVotes;
+};
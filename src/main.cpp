@@ -2,32 +2,199 @@
 #include "../libs/http/httplib.h"
 #include "../libs/nlohmann/json.hpp"
 #include <torch/script.h>
+#include <caffe2/serialize/read_adapter_interface.h>
 #include <libstemmer.h>
 #include <filesystem>
 #include <chrono>
 #include "../libs/xxhash/xxhash.h"
 #include "../libs/cxxopts/cxxopts.hpp"
+#include "request_arena.h"
+#include "allocator.h"
+#include "stemmer_pool.h"
+#include "config.h"
+#include "metrics.h"
+#include "concurrency_limiter.h"
+#include "rate_limiter.h"
+#include "fair_scheduler.h"
+#include "single_flight.h"
+#include "text_simd.h"
+#include "casefold.h"
+#include "english_stemmer.h"
+#include "word_fst.h"
+#include "language_detector.h"
+#include "vocabulary.h"
+#include "bundle.h"
+#include "weight_file.h"
+#include "prediction_cache.h"
+#include "hash_ring.h"
+#include "hash_list.h"
+#if defined(BLOCKTHETWEET_EMBEDDED_VOCABULARY)
+#include "embedded_vocabulary.h"
+#endif
+#include <semaphore>
+#include <future>
+#include <csignal>
+#include <deque>
+#include <set>
+#include <span>
+#include <sys/wait.h>
+#if defined(__GLIBC__)
+#include <pthread.h>
+#endif
+#if defined(__linux__)
+#include <sys/prctl.h>
+#endif
 
 #define author "doddy-s"
 #define version "v0.1"
 #define appName "BlockTheTweet Inference"
 
+// Struct to hold the files serving one additional language
+struct LanguageProfile {
+    std::string modelPath;
+    std::string wordIndexPath;
+    std::string fstPath;
+    bool embeddedVocabulary = false; // Use the word index compiled into the binary instead of wordIndexPath
+    std::string bundlePath; // Bundle from --pack-bundle replacing the model and word index paths
+    std::string weightsPath; // Weight file from --export-weights the model's parameters are mapped from
+};
+
+void to_json(nlohmann::json& json, const LanguageProfile& profile) {
+    json = nlohmann::json{
+        {"model-path", profile.modelPath},
+        {"word-index-path", profile.wordIndexPath},
+        {"fst-path", profile.fstPath},
+        {"embedded-vocabulary", profile.embeddedVocabulary},
+        {"bundle-path", profile.bundlePath},
+        {"weights-path", profile.weightsPath}
+    };
+}
+
+void from_json(const nlohmann::json& json, LanguageProfile& profile) {
+    profile.bundlePath = json.value("bundle-path", "");
+    if (profile.bundlePath.empty()) {
+        json.at("model-path").get_to(profile.modelPath);
+        json.at("word-index-path").get_to(profile.wordIndexPath);
+    }
+    profile.fstPath = json.value("fst-path", "");
+    profile.embeddedVocabulary = json.value("embedded-vocabulary", false);
+    profile.weightsPath = json.value("weights-path", "");
+}
+
+// Struct to hold the server configuration; atomic members may change while serving
+struct Config {
+    std::string configPath;
+    int configPollMs = 1000;
+    std::string modelPath = "./resources/model.pt";
+    std::string wordIndexPath = "./resources/word_index.json";
+    bool embeddedVocabulary = false;
+    std::string bundlePath;
+    int maxLength = 34;
+    std::string weightsPath;
+    bool weightsPopulate = false;
+    bool weightsLock = false;
+    std::string stemmerLang = "english";
+    bool nativeStemmer = true;
+    std::string fstPath;
+    std::map<std::string, LanguageProfile> languages;
+    int port = 3000;
+    int serverThreads = CPPHTTPLIB_THREAD_POOL_COUNT;
+    int workers = 0;
+    int intraOpThreads = 0;
+    int interOpThreads = 0;
+    std::vector<std::string> allocatorOptions;
+    int warmupIterations = 3;
+    std::string warmupTextsPath;
+    int warmupTextsLimit = 10000;
+    std::atomic<int> shutdownGraceMs{ 30000 };
+    std::string clientHeader = "X-API-Key";
+    std::atomic<bool> singleFlight{ true };
+    int predictionCacheMb = 0;
+    std::string predictionCachePath;
+    std::string cacheSnapshotPath;
+    int cacheSnapshotIntervalS = 300;
+    std::vector<std::string> clusterPeers;
+    std::string clusterSelf;
+    std::string clusterSecret;
+    int peerTimeoutMs = 100;
+    int peerRetryMs = 1000;
+    std::string blocklistPath;
+    std::string allowlistPath;
+    LimiterConfig limiter;
+    RateLimitConfig rateLimit;
+    SchedulerConfig scheduler;
+};
+
 // Global variables
-torch::jit::script::Module MODEL; // Single model
-nlohmann::json WORD_INDEX; // Word index for tokenization
-sb_stemmer* STEMMER; // Stemmer for preprocessing text
+Config CONFIG; // Effective configuration
+cxxopts::Options OPTIONS("BlockTheTweet", "A server for text classification using PyTorch models.");
+Settings SETTINGS(OPTIONS); // Tunables shared by the command line and the configuration file
+std::atomic<bool> READY{ false }; // Set once loading and warmup have finished
+std::atomic<bool> STARTUP_FAILED{ false }; // Set when loading failed and the server must exit
+std::atomic<bool> DRAINING{ false }; // Set on SIGTERM; readiness is withdrawn while accepted requests finish
+bool STOPPING = false; // Set once serving has ended, for the background threads to return; guarded by STOPPING_MUTEX
+std::mutex STOPPING_MUTEX;
+std::condition_variable STOPPING_CHANGED;
+Metrics LOCAL_METRICS; // Metrics of a single-process server
+Metrics* METRICS = &LOCAL_METRICS; // Counters and gauges of this process
+std::span<Metrics> PROCESS_METRICS{ &LOCAL_METRICS, 1 }; // Every process's metrics, summed on /metrics; in --workers mode slot 0 is the master's
+AdaptiveLimiter LIMITER(CONFIG.limiter); // Concurrency limit in front of inference
+std::unique_ptr<RateLimiter> RATE_LIMITER; // Token buckets per client, shared by --workers
+
+// Struct to hold the model, vocabulary and stemmers of one language
+struct LanguageContext {
+    size_t index; // Position in LANGUAGES
+    std::string language;
+    LanguageProfile profile;
+    uint64_t salt = 0; // Mixed into text hashes so texts of different languages never share a prediction
+    torch::jit::script::Module model;
+    std::unique_ptr<weight_file::WeightFile> weights; // Shared mapping backing the model's parameters, if any
+    std::unique_ptr<bundle::Bundle> bundle; // Mapped bundle the model and vocabulary come from, if any
+    int64_t maxLength = 34; // Tokens per model input row
+    std::unique_ptr<Vocabulary> vocabulary; // Word index for tokenization
+    size_t wordIndexJsonBytes = 0; // Footprint the word index had as a parsed JSON object, for comparison
+    uint64_t wordIndexHash = 0; // XXH64 of the word index file, which a word FST must have been compiled from
+    std::unique_ptr<word_fst::WordFst> fst; // Optional map from surface words straight to token ids
+    std::unique_ptr<StemmerPool> stemmers; // Stemmers for preprocessing text, one per concurrent request
+    bool nativeStemmer = false; // Whether ASCII words bypass the pool for the built-in English stemmer
+};
+
+std::vector<std::unique_ptr<LanguageContext>> LANGUAGES; // The --stemmer-lang language first, then --languages
+std::unique_ptr<LanguageDetector> LANGUAGE_DETECTOR; // Picks a language for requests that name none
+
+// Struct to hold the duration of each startup phase
+struct StartupTimings {
+    std::mutex mutex;
+    nlohmann::json phases = nlohmann::json::object();
+
+    void record(const std::string& phase, std::chrono::steady_clock::time_point begin) {
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::lock_guard<std::mutex> lock(mutex);
+        phases[phase + "Ms"] = elapsed;
+    }
+
+    nlohmann::json snapshot() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return phases;
+    }
+} STARTUP_TIMINGS;
+
+// JSON type whose strings and containers live in the per-request arena
+using ArenaJson = nlohmann::basic_json<std::map, std::vector, ArenaString, bool, std::int64_t, std::uint64_t, double, ArenaAllocator>;
 
 // Struct to hold prediction results
 struct Prediction {
-    std::string text;
+    std::string_view text;
+    std::string_view language;
     uint64_t text_hash;
     float confidence;
     long long nanosecond;
 
-    std::string toResponseData() {
-        return nlohmann::json{
+    ArenaString toResponseData() {
+        return ArenaJson{
             {"text_hash", text_hash},
             {"text", text},
+            {"language", language},
             {"confidence", confidence},
             {"nanosecond", nanosecond}
         }.dump();
@@ -48,84 +215,478 @@ std::string constructResponse(const int& statusCode, const std::string& message,
     return response.dump();
 }
 
+// Function to tell whether a stemmer language is the one EnglishStemmer implements
+bool isNativeStemmerLanguage(const std::string& language) {
+    return language == "english" || language == "en" || language == "eng";
+}
+
 // Function to stem a word using the stemmer
-std::string stemWord(const std::string& word) {
-    const sb_symbol* stemmed = sb_stemmer_stem(STEMMER, (const sb_symbol*)word.c_str(), word.size());
-    int stemmed_length = sb_stemmer_length(STEMMER);
-    return std::string(reinterpret_cast<const char*>(stemmed), stemmed_length);
+ArenaString stemWord(sb_stemmer* stemmer, std::string_view word) {
+    const sb_symbol* stemmed = sb_stemmer_stem(stemmer, (const sb_symbol*)word.data(), word.size());
+    int stemmed_length = sb_stemmer_length(stemmer);
+    return ArenaString(reinterpret_cast<const char*>(stemmed), stemmed_length);
 }
 
-// Function to tokenize text
-std::vector<int64_t> tokenizeText(const std::string& text, size_t max_length) {
-    std::vector<int64_t> tokenized_text;
+// Function to stem a word natively when possible, checking a libstemmer instance out of the pool
+// only for the first word that needs one
+ArenaString stemWord(const LanguageContext& language, std::optional<StemmerPool::Lease>& stemmer, std::string_view word) {
+    if (language.nativeStemmer && EnglishStemmer::supports(word)) {
+        ArenaString stemmed(word.size(), '\0');
+        stemmed.resize(EnglishStemmer::stem(word, stemmed.data()));
+        return stemmed;
+    }
+    if (!stemmer) stemmer.emplace(language.stemmers->acquire());
+    return stemWord(stemmer->get(), word);
+}
 
-    // Tokenize the input text into words
-    std::istringstream stream(text);
-    std::string word;
+// Function to call f with each lowercased, case folded word of text until it returns false
+template <typename Function>
+void forEachWord(std::string_view text, Function&& f) {
+    // Lowercase the whole text and mark its whitespace with the vector kernel in one pass
+    ArenaString lowered(text.size(), '\0');
+    ArenaVector<uint64_t> spaces((text.size() + 63) / 64);
+    bool ascii = text_simd::LOWER_AND_MARK_SPACES(text.data(), lowered.data(), text.size(), spaces.data());
+    ArenaString folded;
 
-    while (stream >> word) {
-        // Convert word to lowercase to ensure case-insensitivity
-        for (auto& c : word) c = tolower(c);
+    // Split on whitespace like istream extraction does
+    text_simd::forEachWord(spaces.data(), text.size(), [&](size_t begin, size_t end) {
+        // Case fold non-ASCII letters the kernel left alone
+        std::string_view word = std::string_view(lowered).substr(begin, end - begin);
+        if (!ascii) word = casefold::foldUtf8(word, folded);
+        return f(word);
+    });
+}
 
-        // Stem the word
-        word = stemWord(word);
+// Function to map a normalized word to its token id, through the FST when it knows the word
+int64_t wordId(const LanguageContext& language, std::optional<StemmerPool::Lease>& stemmer, std::string_view word) {
+    int64_t id;
+    if (language.fst && language.fst->lookup(word, id)) return id;
 
-        // Check if the word exists in the word_index, otherwise assign default value (e.g., 0)
-        if (WORD_INDEX.find(word) != WORD_INDEX.end()) {
-            tokenized_text.push_back(WORD_INDEX[word]);
-        }
-        else {
-            tokenized_text.push_back(0);  // Default index for unknown words
-        }
-    }
+    // Stem the word
+    ArenaString stemmed = stemWord(language, stemmer, word);
 
-    // Truncate or pad the vector to match max_length
-    if (tokenized_text.size() > max_length) {
-        tokenized_text.resize(max_length);
-    }
-    else if (tokenized_text.size() < max_length) {
-        tokenized_text.resize(max_length, 0);  // Pad with 0
+    // Check if the word exists in the word_index, otherwise assign default value (e.g., 0)
+    return language.vocabulary->lookup(stemmed);
+}
+
+// Function to tokenize texts into the rows of a [texts x max_length] matrix; returns the token count.
+// Words the FST does not know are stemmed first and then looked up together, so their vocabulary
+// probes overlap.
+size_t tokenizeBatch(const LanguageContext& language, const ArenaVector<std::string_view>& texts, size_t max_length, int64_t* rows) {
+    std::fill(rows, rows + texts.size() * max_length, 0);  // Pad with 0
+    std::optional<StemmerPool::Lease> stemmer;
+    ArenaString stems;
+    ArenaVector<std::pair<uint32_t, uint32_t>> stemSpans;
+    ArenaVector<int64_t*> targets;
+    size_t tokens = 0;
+
+    for (size_t i = 0; i < texts.size(); i++) {
+        int64_t* row = rows + i * max_length;
+        size_t count = 0;
+        forEachWord(texts[i], [&](std::string_view word) {
+            int64_t id;
+            if (language.fst && language.fst->lookup(word, id)) {
+                row[count] = id;
+            }
+            else {
+                // Stem the word
+                ArenaString stemmed = stemWord(language, stemmer, word);
+                stemSpans.emplace_back(uint32_t(stems.size()), uint32_t(stemmed.size()));
+                stems.append(stemmed);
+                targets.push_back(row + count);
+            }
+
+            // Words past max_length would be truncated anyway
+            return ++count < max_length;
+        });
+        tokens += count;
     }
 
-    return tokenized_text;
+    // Check if the words exist in the word_index; unknown words get 0
+    ArenaVector<std::string_view> words;
+    words.reserve(stemSpans.size());
+    for (const auto& [offset, length] : stemSpans) words.push_back(std::string_view(stems).substr(offset, length));
+    ArenaVector<int64_t> ids(words.size());
+    language.vocabulary->lookupBatch(words.data(), words.size(), ids.data());
+    for (size_t j = 0; j < ids.size(); j++) *targets[j] = ids[j];
+    return tokens;
 }
 
-// Function to predict text using the loaded model
-bool predictText(const std::string& text, Prediction& prediction) {
+// Struct to hold one text waiting for inference; the submitter fills in the text, its hash and language
+struct InferenceJob {
+    LanguageContext* language = nullptr;
+    Prediction prediction;
+    bool predicted = false;
+    std::binary_semaphore done{ 0 };
+};
+
+// Function to predict a batch of texts of one language with a single forward pass of its model
+bool predictBatch(LanguageContext& language, std::vector<InferenceJob*>& batch) {
+    const int64_t max_length = language.maxLength;
     try {
-        // Tokenize the input text
-        std::vector<int64_t> input_data = tokenizeText(text, 34);
-        torch::Tensor input_tensor = torch::tensor(input_data, torch::dtype(torch::kLong)).unsqueeze(0);
+        // Tokenize the input texts into the rows of one tensor
+        auto beginOfTokenizeTime = std::chrono::steady_clock::now();
+        torch::Tensor input_tensor = torch::empty({ int64_t(batch.size()), max_length }, torch::dtype(torch::kLong));
+        ArenaVector<std::string_view> texts;
+        texts.reserve(batch.size());
+        for (auto job : batch) texts.push_back(job->prediction.text);
+        METRICS->tokens += tokenizeBatch(language, texts, max_length, input_tensor.data_ptr<int64_t>());
+        METRICS->tokenizeLatencyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beginOfTokenizeTime).count();
         std::vector<torch::jit::IValue> inputs;
         inputs.push_back(input_tensor);
 
         // Perform prediction and measure time
         auto beginOfPredictTime = std::chrono::high_resolution_clock::now();
-        at::Tensor output = MODEL.forward(inputs).toTensor();
+        at::Tensor output = language.model.forward(inputs).toTensor().reshape({ -1 }).to(torch::kFloat).contiguous();
         auto endOfPredictTime = std::chrono::high_resolution_clock::now();
         auto predictTime = std::chrono::duration_cast<std::chrono::nanoseconds>(endOfPredictTime - beginOfPredictTime).count();
+        METRICS->forwardCompleted++;
+        METRICS->forwardLatencyNs += predictTime;
+
+        if (output.numel() != int64_t(batch.size())) {
+            throw std::runtime_error("Model returned " + std::to_string(output.numel()) + " values for a batch of "
+                + std::to_string(batch.size()) + ", run with --batch-size 1 if it only accepts single texts");
+        }
 
         // Store prediction results
-        prediction.text = text;
-        prediction.text_hash = XXH64(text.c_str(), text.size(), 0);
-        prediction.confidence = output.item<float>();
-        prediction.nanosecond = predictTime;
+        const float* confidences = output.data_ptr<float>();
+        for (size_t i = 0; i < batch.size(); i++) {
+            Prediction& prediction = batch[i]->prediction;
+            prediction.confidence = confidences[i];
+            prediction.nanosecond = predictTime;
+            batch[i]->predicted = true;
+        }
 
         return true;
     }
     catch (const std::exception& e) {
         std::cerr << "Prediction error: " << e.what() << std::endl;
+        for (auto job : batch) job->predicted = false;
+        return false;
+    }
+}
+
+// Function to predict text using the model of its language, outside of the scheduler
+bool predictText(LanguageContext& language, std::string_view text, Prediction& prediction) {
+    InferenceJob job;
+    job.language = &language;
+    job.prediction.text = text;
+    job.prediction.language = language.language;
+    job.prediction.text_hash = XXH64(text.data(), text.size(), 0);
+    std::vector<InferenceJob*> batch{ &job };
+    bool predicted = predictBatch(language, batch);
+    prediction = job.prediction;
+    return predicted;
+}
+
+// Scheduler forming inference batches fairly across clients
+FairScheduler<InferenceJob> SCHEDULER(CONFIG.scheduler, [](std::vector<InferenceJob*>& batch) {
+    {
+        ArenaScope arenaScope;
+
+        // A forward pass runs one model, so each language of a mixed batch gets its own
+        std::stable_sort(batch.begin(), batch.end(), [](const InferenceJob* a, const InferenceJob* b) {
+            return a->language->index < b->language->index;
+        });
+        for (size_t begin = 0; begin < batch.size();) {
+            size_t end = begin + 1;
+            while (end < batch.size() && batch[end]->language == batch[begin]->language) end++;
+            if (begin == 0 && end == batch.size()) {
+                predictBatch(*batch[begin]->language, batch);
+            }
+            else {
+                std::vector<InferenceJob*> group(batch.begin() + begin, batch.begin() + end);
+                predictBatch(*batch[begin]->language, group);
+            }
+            begin = end;
+        }
+    }
+    METRICS->batches++;
+    METRICS->batchedJobs += batch.size();
+    for (auto job : batch) job->done.release();
+});
+
+// Predictions of texts currently being predicted, shared with identical concurrent requests
+SingleFlight<Prediction> SINGLE_FLIGHT;
+
+// Confidences of texts already predicted, shared by every process mapping the cache
+std::unique_ptr<PredictionCache> PREDICTION_CACHE;
+uint64_t CACHE_TAG = 0; // Identifies the loaded models; mixed into cache keys and tagging snapshots
+
+// Texts with a fixed verdict, reloaded whenever their files change
+std::atomic<std::shared_ptr<const HashList>> BLOCKLIST; // Answered with confidence 1
+std::atomic<std::shared_ptr<const HashList>> ALLOWLIST; // Answered with confidence 0
+
+// Function to key a text's prediction in the cache, apart from other languages and other models
+uint64_t cacheKey(const LanguageContext& language, uint64_t textHash) {
+    return textHash ^ language.salt ^ CACHE_TAG;
+}
+
+// Struct to hold a peer of the cluster and when it may be tried again after failing
+struct Peer {
+    std::string host;
+    int port = 0;
+    std::atomic<int64_t> retryAfterNs{ 0 }; // Requests this peer owns stay local until then (steady clock)
+};
+
+// Cluster of --cluster-peers, each owning the texts whose hash falls on its arcs of the ring
+std::unique_ptr<HashRing> CLUSTER;
+std::vector<std::unique_ptr<Peer>> PEERS; // Indexed like the ring's nodes
+uint32_t SELF = 0; // Index of this instance on the ring
+const std::string FORWARDED_HEADER = "X-BlockTheTweet-Forwarded"; // Carries --cluster-secret on forwarded requests
+const std::string FORWARDED_CLIENT_HEADER = "X-BlockTheTweet-Client"; // Client the forwarding peer identified
+
+// Function to compare a received secret with ours in time that does not depend on where they differ
+bool secretEquals(std::string_view received, std::string_view secret) {
+    size_t length = std::max(received.size(), secret.size());
+    unsigned char difference = received.size() != secret.size();
+    for (size_t i = 0; i < length; i++) {
+        difference |= (i < received.size() ? received[i] : 0) ^ (i < secret.size() ? secret[i] : 0);
+    }
+    return difference == 0;
+}
+
+// Function to let the peer owning a text answer it; false when this instance must, because it owns
+// the text or the owner failed, timed out or recently did
+bool forwardToOwner(const LanguageContext& language, std::string_view text, uint64_t textHash, const std::string& client, httplib::Response& res) {
+    uint32_t owner = CLUSTER->owner(textHash);
+    if (owner == SELF) return false;
+    Peer& peer = *PEERS[owner];
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    if (now < peer.retryAfterNs.load(std::memory_order_relaxed)) {
+        METRICS->peerFallbacks++;
         return false;
     }
+
+    // Every server thread keeps its own keep-alive connection to each peer
+    thread_local std::vector<std::unique_ptr<httplib::Client>> connections;
+    if (connections.size() < PEERS.size()) connections.resize(PEERS.size());
+    auto& connection = connections[owner];
+    if (!connection) {
+        connection = std::make_unique<httplib::Client>(peer.host, peer.port);
+        time_t timeoutUs = time_t(CONFIG.peerTimeoutMs) * 1000;
+        connection->set_connection_timeout(timeoutUs / 1000000, timeoutUs % 1000000);
+        connection->set_read_timeout(timeoutUs / 1000000, timeoutUs % 1000000);
+        connection->set_write_timeout(timeoutUs / 1000000, timeoutUs % 1000000);
+        connection->set_keep_alive(true);
+    }
+    httplib::Headers headers{ {FORWARDED_HEADER, CONFIG.clusterSecret}, {FORWARDED_CLIENT_HEADER, client} };
+    std::string body = nlohmann::json{ {"text", std::string(text)}, {"lang", language.language} }.dump();
+    auto result = connection->Post("/", headers, body, "application/json");
+
+    // The owner's answers below 500 stand: a 429 because answering locally would defeat its load
+    // shedding, other 4xx because the request itself was refused and would be here too
+    if (result && result->status < 500) {
+        METRICS->peerForwarded++;
+        res.status = result->status;
+        res.set_content(result->body, "application/json");
+        return true;
+    }
+    // An owner that could not be reached, timed out or failed with a 5xx is skipped for a while
+    // rather than costing every request a timeout
+    peer.retryAfterNs.store(now + int64_t(CONFIG.peerRetryMs) * 1000000, std::memory_order_relaxed);
+    connection.reset();
+    METRICS->peerFallbacks++;
+    return false;
+}
+
+// Function to find a loaded language by the name it was configured with
+LanguageContext* findLanguage(std::string_view name) {
+    for (auto& language : LANGUAGES) {
+        if (language->language == name) return language.get();
+    }
+    return nullptr;
+}
+
+// Function to pick the language of a text that did not name one
+LanguageContext* detectLanguage(std::string_view text) {
+    if (LANGUAGES.size() == 1) return LANGUAGES.front().get();
+    return LANGUAGES[LANGUAGE_DETECTOR->detect(text)].get();
+}
+
+// Function to identify the client of a request by its API key, or by its address without one
+std::string clientId(const httplib::Request& req) {
+    if (req.has_header(CONFIG.clientHeader)) return "key:" + req.get_header_value(CONFIG.clientHeader);
+    return "ip:" + req.remote_addr;
+}
+
+// Function to read the kB counters of /proc/self/status as bytes
+std::map<std::string, size_t> readProcStatus() {
+    std::map<std::string, size_t> status;
+    std::ifstream file("/proc/self/status");
+    std::string line;
+
+    while (std::getline(file, line)) {
+        auto colon = line.find(':');
+        if (colon == std::string::npos) continue;
+
+        std::istringstream value(line.substr(colon + 1));
+        size_t amount = 0;
+        std::string unit;
+        if (!(value >> amount)) continue;
+        value >> unit;
+        status[line.substr(0, colon)] = unit == "kB" ? amount * 1024 : amount;
+    }
+
+    return status;
+}
+
+// Function to estimate the heap footprint of a nlohmann::json DOM, node and string allocations included
+size_t jsonFootprint(const nlohmann::json& value) {
+    // Red-black tree node header of std::map (color, parent, left, right)
+    constexpr size_t mapNodeHeader = 4 * sizeof(void*);
+    size_t bytes = 0;
+
+    if (value.is_object()) {
+        const auto& object = value.get_ref<const nlohmann::json::object_t&>();
+        bytes += sizeof(nlohmann::json::object_t);
+        for (const auto& [key, child] : object) {
+            bytes += mapNodeHeader + sizeof(std::pair<const std::string, nlohmann::json>);
+            if (key.capacity() > std::string().capacity()) bytes += key.capacity() + 1;
+            bytes += jsonFootprint(child);
+        }
+    }
+    else if (value.is_array()) {
+        const auto& array = value.get_ref<const nlohmann::json::array_t&>();
+        bytes += sizeof(nlohmann::json::array_t) + (array.capacity() - array.size()) * sizeof(nlohmann::json);
+        for (const auto& child : array) {
+            bytes += sizeof(nlohmann::json) + jsonFootprint(child);
+        }
+    }
+    else if (value.is_string()) {
+        const auto& string = value.get_ref<const std::string&>();
+        bytes += sizeof(std::string);
+        if (string.capacity() > std::string().capacity()) bytes += string.capacity() + 1;
+    }
+
+    return bytes;
+}
+
+// Function to collect memory usage by subsystem
+nlohmann::json collectMemoryStats() {
+    auto status = readProcStatus();
+
+    auto languages = nlohmann::json::object();
+    for (const auto& language : LANGUAGES) {
+        size_t parameterCount = 0, parameterBytes = 0, bufferBytes = 0;
+        for (const auto& parameter : language->model.parameters()) {
+            parameterCount += parameter.numel();
+            parameterBytes += parameter.numel() * parameter.element_size();
+        }
+        for (const auto& buffer : language->model.buffers()) {
+            bufferBytes += buffer.numel() * buffer.element_size();
+        }
+        const auto& fst = language->fst;
+        languages[language->language] = {
+            {"model", {
+                {"parameters", parameterCount},
+                {"parameterBytes", parameterBytes},
+                {"bufferBytes", bufferBytes},
+                {"mappedWeightBytes", language->weights ? language->weights->bytes() : 0},
+                {"weightsLocked", language->weights && language->weights->isLocked()}
+            }},
+            {"vocabulary", {
+                {"embedded", language->profile.embeddedVocabulary},
+                {"entries", language->vocabulary->size()},
+                {"bytes", language->vocabulary->bytes()},
+                {"jsonBytes", language->wordIndexJsonBytes}
+            }},
+            {"wordFst", {
+                {"words", fst ? fst->header().wordCount : 0},
+                {"states", fst ? fst->header().stateCount : 0},
+                {"mappedBytes", fst ? fst->bytes() : 0}
+            }},
+            {"bundle", {
+                {"mappedBytes", language->bundle ? language->bundle->bytes() : 0}
+            }},
+            {"stemmers", language->stemmers->size()}
+        };
+    }
+
+    size_t threadCount = status["Threads"];
+    size_t stackSize = 0;
+#if defined(__GLIBC__)
+    pthread_attr_t attr;
+    if (pthread_getattr_default_np(&attr) == 0) {
+        pthread_attr_getstacksize(&attr, &stackSize);
+        pthread_attr_destroy(&attr);
+    }
+#endif
+
+    auto blocklist = BLOCKLIST.load();
+    auto allowlist = ALLOWLIST.load();
+    auto stats = nlohmann::json{
+        {"process", {
+            {"rssBytes", status["VmRSS"]},
+            {"peakRssBytes", status["VmHWM"]},
+            {"anonRssBytes", status["RssAnon"]},
+            {"fileRssBytes", status["RssFile"]},
+            {"virtualBytes", status["VmSize"]}
+        }},
+        {"languages", languages},
+        {"caches", {
+            {"prediction", {
+                {"enabled", PREDICTION_CACHE != nullptr},
+                {"path", PREDICTION_CACHE ? PREDICTION_CACHE->path() : ""},
+                {"bytes", PREDICTION_CACHE ? PREDICTION_CACHE->bytes() : 0},
+                {"capacity", PREDICTION_CACHE ? PREDICTION_CACHE->capacity() : 0},
+                {"entries", PREDICTION_CACHE ? PREDICTION_CACHE->entries() : 0}
+            }}
+        }},
+        {"hashLists", {
+            {"blocklist", {{"entries", blocklist ? blocklist->size() : 0}, {"bytes", blocklist ? blocklist->bytes() : 0}}},
+            {"allowlist", {{"entries", allowlist ? allowlist->size() : 0}, {"bytes", allowlist ? allowlist->bytes() : 0}}}
+        }},
+        {"requestArena", {
+            {"threads", ARENA_STATS.threads.load()},
+            {"initialBytesPerThread", RequestArena::initialSize},
+            {"requests", ARENA_STATS.requests.load()},
+            {"allocations", ARENA_STATS.allocations.load()},
+            {"allocatedBytes", ARENA_STATS.bytes.load()},
+            {"upstreamAllocations", ARENA_STATS.upstreamAllocations.load()},
+            {"upstreamBytes", ARENA_STATS.upstreamBytes.load()}
+        }},
+        {"threads", {
+            {"count", threadCount},
+            {"stackReservedBytes", threadCount * stackSize}
+        }},
+        {"tensorAllocator", {
+            {"device", "cpu"},
+            {"intraOpThreads", at::get_num_threads()},
+            {"interOpThreads", at::get_num_interop_threads()}
+        }},
+        // CPU tensors are allocated through malloc, so their storage is counted here as well
+        {"allocator", allocatorStats()}
+    };
+
+    return stats;
 }
 
 // Controller for handling text classification requests
 void postClassifyText(const httplib::Request& req, httplib::Response& res) {
     res.set_header("Access-Control-Allow-Origin", "*");
+    if (!READY.load(std::memory_order_acquire)) {
+        res.status = 503;
+        res.set_content(constructResponse(503, "Service Unavailable"), "application/json");
+        return;
+    }
+
+    // Count the request so shutdown can wait for it
+    METRICS->requests++;
+    METRICS->requestsInFlight++;
+    struct InFlightGuard {
+        ~InFlightGuard() {
+            if (DRAINING) METRICS->requestsDrained++;
+            METRICS->requestsInFlight--;
+        }
+    } inFlightGuard;
+
+    // Scratch memory of this request is released when the scope ends
+    ArenaScope arenaScope;
     try {
-        nlohmann::json reqBody;
+        ArenaJson reqBody;
         try {
-            reqBody = nlohmann::json::parse(req.body);
+            reqBody = ArenaJson::parse(req.body);
         }
         catch (const std::exception& e) {
             res.status = 400;
@@ -133,18 +694,138 @@ void postClassifyText(const httplib::Request& req, httplib::Response& res) {
             return;
         }
 
-        std::string text = reqBody["text"];
+        const ArenaString& text = reqBody["text"].get_ref<const ArenaString&>();
+        uint64_t textHash = XXH64(text.data(), text.size(), 0);
 
-        Prediction prediction;
+        // Use the language the request names, or the one its characters point to
+        LanguageContext* language;
+        auto lang = reqBody.find("lang");
+        if (lang != reqBody.end()) {
+            language = lang->is_string() ? findLanguage(lang->get_ref<const ArenaString&>()) : nullptr;
+            if (!language) {
+                res.status = 400;
+                res.set_content(constructResponse(400, "Unsupported language"), "application/json");
+                return;
+            }
+        }
+        else {
+            language = detectLanguage(text);
+        }
+
+        // Texts already adjudicated get their verdict without running the model; the blocklist wins
+        // over the allowlist
+        auto beginOfPrecheck = std::chrono::steady_clock::now();
+        auto blocklist = BLOCKLIST.load(std::memory_order_acquire);
+        auto allowlist = ALLOWLIST.load(std::memory_order_acquire);
+        bool blocked = blocklist && blocklist->contains(textHash);
+        if (blocked || (allowlist && allowlist->contains(textHash))) {
+            if (blocked) METRICS->blocklistHits++;
+            else METRICS->allowlistHits++;
+            Prediction prediction{ text, language->language, textHash, blocked ? 1.0f : 0.0f,
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beginOfPrecheck).count() };
+            ArenaString responseData = prediction.toResponseData();
+            res.status = 200;
+            res.set_content(responseData.data(), responseData.size(), "application/json");
+            return;
+        }
+
+        // Requests a peer forwarded were rate limited where they entered the cluster, on behalf of the
+        // client the peer names
+        bool forwarded = CLUSTER && req.has_header(FORWARDED_HEADER) && secretEquals(req.get_header_value(FORWARDED_HEADER), CONFIG.clusterSecret);
+        if (forwarded) METRICS->peerReceived++;
+        std::string client = forwarded && req.has_header(FORWARDED_CLIENT_HEADER) ? req.get_header_value(FORWARDED_CLIENT_HEADER) : clientId(req);
+
+        // Hold each client to its own rate
+        if (!forwarded && !RATE_LIMITER->tryAcquire(client)) {
+            METRICS->rateLimited++;
+            res.status = 429;
+            res.set_content(constructResponse(429, "Too Many Requests"), "application/json");
+            return;
+        }
+
+        // Let the peer owning the text answer it, so each text is predicted and cached on one node
+        if (CLUSTER && !forwarded && forwardToOwner(*language, text, textHash, client, res)) return;
+
+        // Answer texts any process on the host already predicted without running the model
+        if (PREDICTION_CACHE) {
+            auto beginOfLookup = std::chrono::steady_clock::now();
+            float confidence;
+            if (PREDICTION_CACHE->lookup(cacheKey(*language, textHash), confidence)) {
+                METRICS->predictionCacheHits++;
+                Prediction prediction{ text, language->language, textHash, confidence,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - beginOfLookup).count() };
+                ArenaString responseData = prediction.toResponseData();
+                res.status = 200;
+                res.set_content(responseData.data(), responseData.size(), "application/json");
+                return;
+            }
+            METRICS->predictionCacheMisses++;
+        }
 
-        if (!predictText(text, prediction)) {
+        // Wait for an identical text already being predicted instead of predicting it again; if that
+        // request produced nothing, fall through and predict this one
+        auto flight = CONFIG.singleFlight ? SINGLE_FLIGHT.join(textHash ^ language->salt, text) : SingleFlight<Prediction>::Ticket();
+        if (flight.isFollower()) {
+            if (auto shared = flight.wait()) {
+                METRICS->coalesced++;
+                Prediction prediction = *shared;
+                prediction.text = text;
+                ArenaString responseData = prediction.toResponseData();
+                res.status = 200;
+                res.set_content(responseData.data(), responseData.size(), "application/json");
+                return;
+            }
+        }
+
+        // Shed load beyond the concurrency the target latency allows
+        if (!LIMITER.tryAcquire()) {
+            METRICS->concurrencyRejected++;
+            res.status = 429;
+            res.set_content(constructResponse(429, "Too Many Requests"), "application/json");
+            return;
+        }
+        METRICS->inferenceInFlight = LIMITER.currentInFlight();
+
+        // Queue the text behind the other clients' and wait for its batch
+        InferenceJob job;
+        job.language = language;
+        job.prediction.text = text;
+        job.prediction.language = language->language;
+        job.prediction.text_hash = textHash;
+        auto beginOfInference = std::chrono::steady_clock::now();
+        if (!SCHEDULER.submit(client, &job)) {
+            LIMITER.cancel();
+            METRICS->queueRejected++;
+            res.status = 429;
+            res.set_content(constructResponse(429, "Too Many Requests"), "application/json");
+            return;
+        }
+        job.done.acquire();
+        bool predicted = job.predicted;
+        Prediction& prediction = job.prediction;
+        auto inferenceTime = std::chrono::steady_clock::now() - beginOfInference;
+
+        LIMITER.release(inferenceTime);
+        METRICS->inferenceCompleted++;
+        METRICS->inferenceLatencyNs += std::chrono::duration_cast<std::chrono::nanoseconds>(inferenceTime).count();
+        METRICS->inferenceInFlight = LIMITER.currentInFlight();
+        METRICS->concurrencyLimit = CONFIG.limiter.enabled ? LIMITER.currentLimit() : 0;
+
+        if (!predicted) {
             res.status = 500;
             res.set_content(constructResponse(500, "Internal Server Error"), "application/json");
             return;
         }
 
+        flight.publish(prediction);
+        if (PREDICTION_CACHE) {
+            METRICS->predictionCacheInserts++;
+            if (PREDICTION_CACHE->insert(cacheKey(*language, textHash), prediction.confidence)) METRICS->predictionCacheEvictions++;
+        }
+
+        ArenaString responseData = prediction.toResponseData();
         res.status = 200;
-        res.set_content(prediction.toResponseData(), "application/json");
+        res.set_content(responseData.data(), responseData.size(), "application/json");
     }
     catch (const std::exception& e) {
         std::cerr << "Caught standard exception: " << e.what() << std::endl;
@@ -166,6 +847,69 @@ void getInformations(const httplib::Request&, httplib::Response& res) {
     res.set_content(constructResponse(200, "success", data), "application/json");
 }
 
+// Controller for reporting memory usage by subsystem
+void getDebugMemory(const httplib::Request&, httplib::Response& res) {
+    res.set_header("Access-Control-Allow-Origin", "*");
+    if (!READY.load(std::memory_order_acquire)) {
+        res.status = 503;
+        res.set_content(constructResponse(503, "Service Unavailable"), "application/json");
+        return;
+    }
+    try {
+        res.status = 200;
+        res.set_content(constructResponse(200, "success", collectMemoryStats()), "application/json");
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Caught standard exception: " << e.what() << std::endl;
+        res.status = 500;
+        res.set_content(constructResponse(500, "Internal Server Error"), "application/json");
+    }
+}
+
+// Controller for reporting statistics of the linked allocator
+void getDebugAllocator(const httplib::Request&, httplib::Response& res) {
+    res.set_header("Access-Control-Allow-Origin", "*");
+    res.status = 200;
+    res.set_content(constructResponse(200, "success", allocatorStats()), "application/json");
+}
+
+// Controller for liveness probes, answered as soon as the port is bound
+void getHealthz(const httplib::Request&, httplib::Response& res) {
+    res.status = 200;
+    res.set_content(constructResponse(200, "alive"), "application/json");
+}
+
+// Controller for readiness probes, ready only once loading and warmup have finished
+void getReadyz(const httplib::Request&, httplib::Response& res) {
+    bool ready = READY.load(std::memory_order_acquire) && !DRAINING;
+    auto data = nlohmann::json{
+        {"ready", ready},
+        {"draining", DRAINING.load()},
+        {"startup", STARTUP_TIMINGS.snapshot()}
+    };
+    res.status = ready ? 200 : 503;
+    res.set_content(constructResponse(res.status, ready ? "ready" : "not ready", data), "application/json");
+}
+
+// Controller for reporting the effective configuration
+void getAdminConfig(const httplib::Request&, httplib::Response& res) {
+    res.set_header("Access-Control-Allow-Origin", "*");
+    auto data = nlohmann::json{
+        {"path", CONFIG.configPath},
+        {"settings", SETTINGS.toJson()}
+    };
+    res.status = 200;
+    res.set_content(constructResponse(200, "success", data), "application/json");
+}
+
+// Controller for exporting metrics in the Prometheus text format
+void getMetrics(const httplib::Request&, httplib::Response& res) {
+    METRICS->concurrencyLimit = CONFIG.limiter.enabled ? LIMITER.currentLimit() : 0;
+    METRICS->queuedJobs = SCHEDULER.queuedJobs();
+    res.status = 200;
+    res.set_content(renderMetrics(PROCESS_METRICS.data(), PROCESS_METRICS.size()), "text/plain; version=0.0.4");
+}
+
 // Function to attach routes to the server
 void attachRoutes(httplib::Server& server) {
     server.Options(".*", [](const httplib::Request&, httplib::Response& res) {
@@ -178,59 +922,1048 @@ void attachRoutes(httplib::Server& server) {
 
     server.Get("/", getInformations);
     server.Post("/", postClassifyText);
+    server.Get("/debug/memory", getDebugMemory);
+    server.Get("/debug/allocator", getDebugAllocator);
+    server.Get("/healthz", getHealthz);
+    server.Get("/readyz", getReadyz);
+    server.Get("/admin/config", getAdminConfig);
+    server.Get("/metrics", getMetrics);
 }
 
-// Main function
-int main(int argc, char* argv[]) {
-    // Parse command-line arguments
-    cxxopts::Options options("BlockTheTweet", "A server for text classification using PyTorch models.");
-    options.add_options()
-        ("m,model-path", "Path to the model file", cxxopts::value<std::string>()->default_value("./resources/model.pt"))
-        ("w,word-index-path", "Path to word index JSON file", cxxopts::value<std::string>()->default_value("./resources/word_index.json"))
-        ("s,stemmer-lang", "Stemmer language", cxxopts::value<std::string>()->default_value("english"))
-        ("p,port", "Port to run the server on", cxxopts::value<int>()->default_value("3000"))
-        ("h,help", "Print usage");
+// Function to run a startup phase and record how long it took
+template <typename Function>
+void timePhase(const std::string& phase, Function&& function) {
+    auto begin = std::chrono::steady_clock::now();
+    function();
+    STARTUP_TIMINGS.record(phase, begin);
+}
+
+// Function to set up the languages to load: --stemmer-lang with the top-level paths, then --languages
+void configureLanguages() {
+    if (CONFIG.maxLength <= 0) throw std::invalid_argument("--max-length must be positive");
+    auto add = [](const std::string& name, const LanguageProfile& profile) {
+        auto language = std::make_unique<LanguageContext>();
+        language->index = LANGUAGES.size();
+        language->language = name;
+        language->profile = profile;
+        language->maxLength = CONFIG.maxLength;
+        if (!profile.bundlePath.empty()) {
+            // A bundle carries its stemmer language: the first language takes it, others must match it
+            timePhase(LANGUAGES.empty() ? "bundle" : "bundle." + name, [&] { language->bundle = bundle::Bundle::open(profile.bundlePath); });
+            if (LANGUAGES.empty()) {
+                language->language = language->bundle->language();
+            }
+            else if (language->bundle->language() != name) {
+                throw std::invalid_argument("Bundle " + profile.bundlePath + " is for stemmer language " + language->bundle->language() + ", not " + name);
+            }
+            language->maxLength = language->bundle->header().maxLength;
+        }
+        const std::string& resolved = language->language;
+        if (findLanguage(resolved)) throw std::invalid_argument("Language configured twice: " + resolved);
+        language->salt = LANGUAGES.empty() ? 0 : XXH64(resolved.data(), resolved.size(), 0);
+        language->nativeStemmer = CONFIG.nativeStemmer && isNativeStemmerLanguage(resolved);
+        LANGUAGES.push_back(std::move(language));
+    };
+    add(CONFIG.stemmerLang, LanguageProfile{ CONFIG.modelPath, CONFIG.wordIndexPath, CONFIG.fstPath, CONFIG.embeddedVocabulary, CONFIG.bundlePath, CONFIG.weightsPath });
+    for (const auto& [name, profile] : CONFIG.languages) add(name, profile);
+
+    std::vector<std::string> names;
+    for (const auto& language : LANGUAGES) names.push_back(language->language);
+    LANGUAGE_DETECTOR = std::make_unique<LanguageDetector>(names);
+}
+
+// Function to load a block or allow list, keeping the previous one if the file cannot be read
+// unless there is none yet
+void loadHashList(std::atomic<std::shared_ptr<const HashList>>& list, const std::string& path, const std::string& name) {
+    try {
+        auto loaded = HashList::load(path);
+        list.store(loaded, std::memory_order_release);
+        std::cout << "Loaded " << name << " from: " << path << " (" << loaded->size() << " texts, " << loaded->bytes() << " bytes)" << std::endl;
+    }
+    catch (const std::exception& e) {
+        if (!list.load()) throw;
+        std::cerr << "Error reloading " << name << ", keeping the previous one: " << e.what() << std::endl;
+    }
+}
+
+// Function to sleep up to timeout between the rounds of a background thread; true once it must return
+bool waitForStop(std::chrono::milliseconds timeout) {
+    std::unique_lock<std::mutex> lock(STOPPING_MUTEX);
+    return STOPPING_CHANGED.wait_for(lock, timeout, [] { return STOPPING; });
+}
+
+// Function to tell the background threads to return
+void stopBackgroundThreads() {
+    {
+        std::lock_guard<std::mutex> lock(STOPPING_MUTEX);
+        STOPPING = true;
+    }
+    STOPPING_CHANGED.notify_all();
+}
+
+// Function to reload the block and allow lists whenever their modification times change
+void watchHashLists() {
+    std::vector<std::tuple<std::atomic<std::shared_ptr<const HashList>>*, std::string, std::string, std::filesystem::file_time_type>> lists;
+    std::error_code error;
+    if (!CONFIG.blocklistPath.empty()) lists.emplace_back(&BLOCKLIST, CONFIG.blocklistPath, "blocklist", std::filesystem::last_write_time(CONFIG.blocklistPath, error));
+    if (!CONFIG.allowlistPath.empty()) lists.emplace_back(&ALLOWLIST, CONFIG.allowlistPath, "allowlist", std::filesystem::last_write_time(CONFIG.allowlistPath, error));
+    while (!waitForStop(std::chrono::milliseconds(CONFIG.configPollMs))) {
+        for (auto& [list, path, name, lastWrite] : lists) {
+            auto write = std::filesystem::last_write_time(path, error);
+            if (error || write == lastWrite) continue;
+            lastWrite = write;
+            loadHashList(*list, path, name);
+        }
+    }
+}
+
+// Function to build the ring of --cluster-peers and find this instance on it
+void configureCluster() {
+    if (CONFIG.clusterPeers.empty()) return;
+    // Forwarded requests skip rate limiting and name their client, so only peers may send them
+    if (CONFIG.clusterSecret.empty()) throw std::runtime_error("--cluster-peers needs a --cluster-secret shared by every peer");
+    auto self = std::find(CONFIG.clusterPeers.begin(), CONFIG.clusterPeers.end(), CONFIG.clusterSelf);
+    if (self == CONFIG.clusterPeers.end()) throw std::runtime_error("--cluster-self must be one of --cluster-peers: " + CONFIG.clusterSelf);
+    for (const auto& address : CONFIG.clusterPeers) {
+        auto colon = address.rfind(':');
+        if (colon == std::string::npos) throw std::runtime_error("Cluster peer is not host:port: " + address);
+        auto peer = std::make_unique<Peer>();
+        peer->host = address.substr(0, colon);
+        peer->port = std::stoi(address.substr(colon + 1));
+        PEERS.push_back(std::move(peer));
+    }
+    CLUSTER = std::make_unique<HashRing>(CONFIG.clusterPeers, 128);
+    SELF = uint32_t(self - CONFIG.clusterPeers.begin());
+    std::cout << "Routing texts across " << PEERS.size() << " cluster peers as: " << CONFIG.clusterSelf << std::endl;
+}
+
+// Function to load the word index of a language, remembering the hash of its file
+void loadWordIndex(LanguageContext& language) {
+    if (language.bundle) {
+        language.wordIndexHash = language.bundle->header().wordIndexHash;
+        language.vocabulary = language.bundle->vocabulary();
+        return;
+    }
+    if (language.profile.embeddedVocabulary) {
+#if defined(BLOCKTHETWEET_EMBEDDED_VOCABULARY)
+        language.wordIndexHash = EMBEDDED_WORD_INDEX_HASH;
+        language.vocabulary = embeddedVocabulary();
+        return;
+#else
+        throw std::runtime_error("This build has no embedded vocabulary, configure it with -DBLOCKTHETWEET_EMBEDDED_VOCABULARY=<word_index.json>");
+#endif
+    }
+
+    const std::string& path = language.profile.wordIndexPath;
+    std::ifstream f(path, std::ios::binary);
+    if (!f) throw std::runtime_error("Cannot open word index: " + path);
+    std::string contents((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    language.wordIndexHash = XXH64(contents.data(), contents.size(), 0);
+    auto wordIndex = nlohmann::json::parse(contents);
+    language.wordIndexJsonBytes = sizeof(wordIndex) + jsonFootprint(wordIndex);
+    language.vocabulary = std::make_unique<PackedVocabulary>(wordIndex);
+}
+
+// Function to map the word FST of a language, checking it was compiled from its word index and stemmer
+void loadWordFst(LanguageContext& language) {
+    const std::string& path = language.profile.fstPath;
+    auto fst = word_fst::WordFst::open(path);
+    const auto& header = fst->header();
+    std::string compiledFor(header.language, strnlen(header.language, sizeof(header.language)));
+    if (header.vocabularyHash != language.wordIndexHash) {
+        throw std::runtime_error("Word FST " + path + " was compiled from a different word index, recompile it with --compile-fst");
+    }
+    if (compiledFor != language.language) {
+        throw std::runtime_error("Word FST " + path + " was compiled for stemmer language " + compiledFor + ", not " + language.language);
+    }
+    language.fst = std::move(fst);
+}
+
+// Class to let libtorch read a TorchScript archive straight from a mapped bundle section
+class BundleReadAdapter : public caffe2::serialize::ReadAdapterInterface {
+public:
+    explicit BundleReadAdapter(std::string_view bytes) : bytes(bytes) {}
+
+    size_t size() const override { return bytes.size(); }
+
+    size_t read(uint64_t pos, void* buf, size_t n, const char* what = "") const override {
+        if (pos >= bytes.size()) return 0;
+        n = std::min<size_t>(n, bytes.size() - pos);
+        std::memcpy(buf, bytes.data() + pos, n);
+        return n;
+    }
+
+private:
+    std::string_view bytes;
+};
+
+// Function to load the TorchScript model of a language from its bundle or model path
+void loadModel(LanguageContext& language) {
+    if (language.bundle) {
+        language.model = torch::jit::load(std::make_shared<BundleReadAdapter>(language.bundle->section(bundle::Section::Model)));
+    }
+    else {
+        language.model = torch::jit::load(language.profile.modelPath);
+    }
+}
+
+// Function to hash the TorchScript archive of a language, which its weight file must be exported from
+uint64_t modelHash(const LanguageContext& language) {
+    if (language.bundle) {
+        auto model = language.bundle->section(bundle::Section::Model);
+        return XXH64(model.data(), model.size(), 0);
+    }
+    std::ifstream f(language.profile.modelPath, std::ios::binary);
+    if (!f) throw std::runtime_error("Cannot open model: " + language.profile.modelPath);
+    std::string contents((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+    return XXH64(contents.data(), contents.size(), 0);
+}
+
+// Function to swap every parameter and buffer of a loaded model for a view of the weight file, freeing
+// the private copies libtorch loaded; processes mapping the same file then share its pages
+void mapWeights(LanguageContext& language) {
+    const std::string& path = language.profile.weightsPath;
+    auto weights = weight_file::WeightFile::open(path, CONFIG.weightsPopulate);
+    if (weights->header().modelHash != modelHash(language)) {
+        throw std::runtime_error("Weight file " + path + " was exported from a different model, re-export it with --export-weights");
+    }
+
+    auto attach = [&](const std::string& name, torch::Tensor tensor) {
+        const weight_file::TensorEntry* entry = weights->find(name);
+        if (!entry) throw std::runtime_error("Weight file " + path + " has no tensor " + name);
+        std::vector<int64_t> sizes(entry->sizes, entry->sizes + entry->dims);
+        if (entry->dtype != int32_t(tensor.scalar_type()) || sizes != tensor.sizes().vec()) {
+            throw std::runtime_error("Weight file " + path + " has a different type or shape for " + name);
+        }
+        // from_blob reads as many bytes as the shape needs, which must all be the entry's and mapped
+        if (entry->bytes != tensor.nbytes() || entry->offset > weights->bytes() || entry->bytes > weights->bytes() - entry->offset) {
+            throw std::runtime_error("Weight file " + path + " has " + std::to_string(entry->bytes) + " bytes for " + name
+                + ", which needs " + std::to_string(tensor.nbytes()));
+        }
+        // Inference never writes parameters; the mapping is read-only all the same
+        void* data = const_cast<void*>(weights->tensorData(*entry));
+        tensor.set_data(torch::from_blob(data, sizes, torch::dtype(tensor.scalar_type())));
+    };
+    for (const auto& parameter : language.model.named_parameters()) attach(parameter.name, parameter.value);
+    for (const auto& buffer : language.model.named_buffers()) attach(buffer.name, buffer.value);
+
+    if (CONFIG.weightsLock) weights->lock();
+    language.weights = std::move(weights);
+}
+
+// Function to load the model, word index, word FST and stemmers of a language concurrently.
+// Phases of the first language keep their plain names, others are suffixed with the language.
+void loadLanguage(LanguageContext& language) {
+    std::string suffix = language.index == 0 ? "" : "." + language.language;
+    const LanguageProfile& profile = language.profile;
+
+    // Load the model, then move its parameters onto the shared weight file
+    auto model = std::async(std::launch::async, [&] {
+        timePhase("model" + suffix, [&] { loadModel(language); });
+        std::cout << "Loaded model from: " << (language.bundle ? profile.bundlePath : profile.modelPath) << std::endl;
+        if (!profile.weightsPath.empty()) {
+            timePhase("weights" + suffix, [&] { mapWeights(language); });
+            std::cout << "Mapped model weights from: " << profile.weightsPath << " (" << language.weights->bytes() << " bytes"
+                << (language.weights->isLocked() ? ", locked" : "") << ")" << std::endl;
+        }
+    });
+
+    // Load word index for tokenization
+    auto wordIndex = std::async(std::launch::async, [&] {
+        timePhase("wordIndex" + suffix, [&] { loadWordIndex(language); });
+        if (language.bundle) {
+            std::cout << "Loaded word index from: " << profile.bundlePath << " (" << language.vocabulary->size() << " words)" << std::endl;
+        }
+        else if (profile.embeddedVocabulary) {
+            std::cout << "Using the embedded word index (" << language.vocabulary->size() << " words)" << std::endl;
+        }
+        else {
+            std::cout << "Loaded word index from: " << profile.wordIndexPath << " (" << language.vocabulary->bytes()
+                << " bytes, " << language.wordIndexJsonBytes << " as JSON)" << std::endl;
+        }
+        if (!profile.fstPath.empty()) {
+            timePhase("wordFst" + suffix, [&] { loadWordFst(language); });
+            std::cout << "Loaded word FST from: " << profile.fstPath << " (" << language.fst->header().wordCount << " words)" << std::endl;
+        }
+    });
+
+    // Initialize the stemmers; with the built-in English stemmer they only handle non-ASCII words
+    auto stemmers = std::async(std::launch::async, [&] {
+        timePhase("stemmers" + suffix, [&] {
+            size_t size = language.nativeStemmer ? 1 : std::max(1, CONFIG.serverThreads);
+            language.stemmers = std::make_unique<StemmerPool>(language.language, size);
+        });
+        if (language.nativeStemmer) std::cout << "Using the built-in English stemmer for ASCII " << language.language << " words" << std::endl;
+    });
+
+    model.get();
+    wordIndex.get();
+    stemmers.get();
+}
 
-    auto result = options.parse(argc, argv);
+// Function to tag the prediction cache with the models, vocabularies and input lengths of every
+// language, so cached confidences of other models are never served, then fill it from the snapshot
+void loadCacheSnapshot() {
+    CACHE_TAG = 0;
+    for (const auto& language : LANGUAGES) {
+        uint64_t parts[] = { language->salt, modelHash(*language), language->wordIndexHash, uint64_t(language->maxLength) };
+        CACHE_TAG = XXH64(parts, sizeof(parts), CACHE_TAG);
+    }
+
+    const std::string& path = CONFIG.cacheSnapshotPath;
+    if (path.empty()) return;
+    if (!std::filesystem::exists(path)) {
+        std::cout << "No prediction cache snapshot at: " << path << std::endl;
+        return;
+    }
+    // A stale or damaged snapshot only costs the warm start
+    try {
+        size_t entries = PREDICTION_CACHE->load(path, CACHE_TAG);
+        std::cout << "Loaded prediction cache snapshot from: " << path << " (" << entries << " entries)" << std::endl;
+    }
+    catch (const std::runtime_error& e) {
+        std::cerr << "Ignoring prediction cache snapshot: " << e.what() << std::endl;
+    }
+}
+
+// Function to snapshot the prediction cache, if configured
+void saveCacheSnapshot() {
+    if (!PREDICTION_CACHE || CONFIG.cacheSnapshotPath.empty()) return;
+    try {
+        auto begin = std::chrono::steady_clock::now();
+        size_t entries = PREDICTION_CACHE->save(CONFIG.cacheSnapshotPath, CACHE_TAG);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        std::cout << "Saved prediction cache snapshot to: " << CONFIG.cacheSnapshotPath << " (" << entries << " entries, " << elapsed << " ms)" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error saving prediction cache snapshot: " << e.what() << std::endl;
+    }
+}
+
+// Function to snapshot the prediction cache every --cache-snapshot-interval-s until serving ends
+void snapshotCachePeriodically() {
+    while (!waitForStop(std::chrono::seconds(std::max(1, CONFIG.cacheSnapshotIntervalS)))) {
+        saveCacheSnapshot();
+    }
+}
 
-    if (result.count("help")) {
-        std::cout << options.help() << std::endl;
-        return 0;
+// Function to predict the most frequent recent texts of --warmup-texts-path in full batches on every
+// inference thread and store them in the prediction cache, so popular texts hit it from the first
+// request and the JIT has seen real inputs. Texts a snapshot already cached are skipped. Workers of
+// --workers share the cache and warm up at once, so each predicts only its share: one text in every
+// --workers.
+void warmUpFromTexts(int worker) {
+    const std::string& path = CONFIG.warmupTextsPath;
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("Cannot open warmup texts: " + path);
+    std::vector<std::string> texts;
+    size_t limit = CONFIG.warmupTextsLimit > 0 ? size_t(CONFIG.warmupTextsLimit) : SIZE_MAX;
+    for (std::string line; texts.size() < limit && std::getline(in, line);) {
+        if (!line.empty()) texts.push_back(std::move(line));
     }
 
-    std::string modelPath = result["model-path"].as<std::string>();
-    std::string wordIndexPath = result["word-index-path"].as<std::string>();
-    std::string stemmerLang = result["stemmer-lang"].as<std::string>();
-    int port = result["port"].as<int>();
+    // Group the texts by language, as a forward pass runs one model
+    std::vector<std::deque<InferenceJob>> jobs(LANGUAGES.size()); // Jobs hold a semaphore and cannot move
+    size_t shards = worker > 0 && PREDICTION_CACHE ? size_t(CONFIG.workers) : 1;
+    size_t cached = 0, skipped = 0;
+    for (size_t i = 0; i < texts.size(); i++) {
+        const std::string& text = texts[i];
+        if (shards > 1 && i % shards != size_t(worker - 1)) {
+            skipped++;
+            continue;
+        }
+        LanguageContext* language = detectLanguage(text);
+        uint64_t textHash = XXH64(text.data(), text.size(), 0);
+        float confidence;
+        if (PREDICTION_CACHE && PREDICTION_CACHE->lookup(cacheKey(*language, textHash), confidence)) {
+            cached++;
+            continue;
+        }
+        InferenceJob& job = jobs[language->index].emplace_back();
+        job.language = language;
+        job.prediction.text = text;
+        job.prediction.language = language->language;
+        job.prediction.text_hash = textHash;
+    }
 
-    httplib::Server server;
+    std::vector<std::pair<size_t, size_t>> batches; // Language index, first job
+    size_t batchSize = size_t(std::max(1, CONFIG.scheduler.batchSize.load()));
+    for (size_t language = 0; language < jobs.size(); language++) {
+        for (size_t begin = 0; begin < jobs[language].size(); begin += batchSize) batches.emplace_back(language, begin);
+    }
+
+    std::atomic<size_t> next{ 0 }, failed{ 0 };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < std::max(1, CONFIG.scheduler.threads); i++) {
+        threads.emplace_back([&] {
+            for (size_t b; (b = next.fetch_add(1)) < batches.size();) {
+                ArenaScope arenaScope;
+                auto& languageJobs = jobs[batches[b].first];
+                size_t begin = batches[b].second, end = std::min(begin + batchSize, languageJobs.size());
+                std::vector<InferenceJob*> batch;
+                for (size_t j = begin; j < end; j++) batch.push_back(&languageJobs[j]);
+                if (!predictBatch(*LANGUAGES[batches[b].first], batch)) {
+                    failed += batch.size();
+                    continue;
+                }
+                if (!PREDICTION_CACHE) continue;
+                for (auto job : batch) {
+                    PREDICTION_CACHE->insert(cacheKey(*job->language, job->prediction.text_hash), job->prediction.confidence);
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+
+    if (failed > 0) throw std::runtime_error("Warmup prediction failed for " + std::to_string(failed.load()) + " texts of " + path);
+    std::cout << "Predicted warmup texts from: " << path << " (" << texts.size() - cached - skipped << " predicted, " << cached << " already cached, " << skipped << " left to other workers"
+        << (PREDICTION_CACHE ? "" : ", no prediction cache to fill") << ")" << std::endl;
+}
 
+// Function to load all languages concurrently and/or warm their models up. The master of --workers
+// only loads, as warmup starts libtorch's thread pools, which would not survive fork; its workers
+// then only warm up, worker being their index.
+bool loadResources(bool load, bool warmUp, int worker) {
+    auto beginOfStartup = std::chrono::steady_clock::now();
     try {
-        // Load the model
-        MODEL = torch::jit::load(modelPath);
-        std::cout << "Loaded model from: " << modelPath << std::endl;
+        if (load) {
+            // libtorch thread pools must be sized before any parallel work starts
+            if (CONFIG.intraOpThreads > 0) at::set_num_threads(CONFIG.intraOpThreads);
+            if (CONFIG.interOpThreads > 0) at::set_num_interop_threads(CONFIG.interOpThreads);
 
-        // Load word index for tokenization
-        std::ifstream f(wordIndexPath);
-        WORD_INDEX = nlohmann::json::parse(f);
-        std::cout << "Loaded word index from: " << wordIndexPath << std::endl;
+            // Load every language at once
+            std::vector<std::future<void>> languages;
+            for (auto& language : LANGUAGES) {
+                languages.push_back(std::async(std::launch::async, [&] { loadLanguage(*language); }));
+            }
+            for (auto& language : languages) language.get();
+        }
+
+        if (load && PREDICTION_CACHE) timePhase("cacheSnapshot", loadCacheSnapshot);
 
-        // Initialize the stemmer
-        STEMMER = sb_stemmer_new(stemmerLang.c_str(), nullptr);
+        // Run a few single and full batches so the JIT profiles and optimizes the graph before real traffic
+        if (warmUp) timePhase("warmup", [&] {
+            for (auto& language : LANGUAGES) {
+                std::vector<InferenceJob> jobs(std::max(1, CONFIG.scheduler.batchSize.load()));
+                std::vector<InferenceJob*> single{ &jobs[0] }, full;
+                std::string_view text = "warm up the model before serving traffic";
+                for (auto& job : jobs) {
+                    job.language = language.get();
+                    job.prediction.text = text;
+                    job.prediction.text_hash = XXH64(text.data(), text.size(), 0);
+                    full.push_back(&job);
+                }
+                for (int i = 0; i < CONFIG.warmupIterations; i++) {
+                    if (!predictBatch(*language, single) || !predictBatch(*language, full)) {
+                        throw std::runtime_error("Warmup prediction failed for " + language->language);
+                    }
+                }
+            }
+        });
+        if (warmUp && !CONFIG.warmupTextsPath.empty()) timePhase("warmupTexts", [&] { warmUpFromTexts(worker); });
     }
     catch (const c10::Error& e) {
         std::cerr << "Error loading the model: " << e.what() << std::endl;
+        return false;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return false;
+    }
+
+    STARTUP_TIMINGS.record("total", beginOfStartup);
+    std::cout << "Startup timings: " << STARTUP_TIMINGS.snapshot().dump() << std::endl;
+    if (warmUp) READY.store(true, std::memory_order_release);
+    return true;
+}
+
+// Function to compile the word FST at --fst-path from every vocabulary entry and every word of a list
+// of surface forms that maps to one; returns the process exit code
+int compileWordFst(const std::string& wordListPath) {
+    if (CONFIG.fstPath.empty()) {
+        std::cerr << "Error: --compile-fst needs --fst-path for its output" << std::endl;
+        return -1;
+    }
+    std::ifstream f(wordListPath);
+    if (!f) {
+        std::cerr << "Error: cannot open word list: " << wordListPath << std::endl;
+        return -1;
+    }
+
+    try {
+        // Only the --stemmer-lang language is compiled; its FST must not be loaded while compiling it
+        LanguageContext language;
+        language.index = 0;
+        language.language = CONFIG.stemmerLang;
+        language.profile = LanguageProfile{ CONFIG.modelPath, CONFIG.wordIndexPath, "", CONFIG.embeddedVocabulary, CONFIG.bundlePath, CONFIG.weightsPath };
+        if (!CONFIG.bundlePath.empty()) {
+            language.bundle = bundle::Bundle::open(CONFIG.bundlePath);
+            language.language = language.bundle->language();
+        }
+        language.nativeStemmer = CONFIG.nativeStemmer && isNativeStemmerLanguage(language.language);
+        language.stemmers = std::make_unique<StemmerPool>(language.language, 1);
+        loadWordIndex(language);
+
+        // Resolve each word exactly as tokenizeBatch would; unknown words stay out and keep mapping to 0
+        std::vector<std::pair<std::string, int32_t>> words;
+        std::optional<StemmerPool::Lease> stemmer;
+        auto addWords = [&](std::string_view text) {
+            ArenaScope arena;
+            forEachWord(text, [&](std::string_view word) {
+                int64_t id = wordId(language, stemmer, word);
+                if (id < INT32_MIN || id > INT32_MAX) throw std::runtime_error("Token id out of range: " + std::to_string(id));
+                if (id != 0) words.emplace_back(std::string(word), int32_t(id));
+                return true;
+            });
+        };
+        language.vocabulary->forEach([&](std::string_view word, int64_t) { addWords(word); });
+        for (std::string line; std::getline(f, line);) addWords(line);
+
+        size_t states = word_fst::WordFstBuilder::write(CONFIG.fstPath, std::move(words), language.wordIndexHash, language.language);
+        auto fst = word_fst::WordFst::open(CONFIG.fstPath);
+        std::cout << "Compiled " << fst->header().wordCount << " words into " << states << " states, "
+            << fst->bytes() << " bytes: " << CONFIG.fstPath << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    return 0;
+}
+
+// Function to pack --model-path, --word-index-path, --stemmer-lang and --max-length into one bundle;
+// returns the process exit code
+int packBundle(const std::string& path) {
+    try {
+        LanguageContext language;
+        language.index = 0;
+        language.language = CONFIG.stemmerLang;
+        language.profile = LanguageProfile{ CONFIG.modelPath, CONFIG.wordIndexPath, "", CONFIG.embeddedVocabulary, "", "" };
+        loadWordIndex(language);
+
+        // Refuse to pack what the server could not load
+        if (CONFIG.maxLength <= 0) throw std::invalid_argument("--max-length must be positive");
+        StemmerPool stemmers(language.language, 1);
+        torch::jit::load(CONFIG.modelPath);
+
+        bundle::Contents contents;
+        contents.language = language.language;
+        contents.maxLength = uint32_t(CONFIG.maxLength);
+        contents.wordIndexHash = language.wordIndexHash;
+        std::ifstream model(CONFIG.modelPath, std::ios::binary);
+        if (!model) throw std::runtime_error("Cannot open model: " + CONFIG.modelPath);
+        contents.model.assign(std::istreambuf_iterator<char>(model), std::istreambuf_iterator<char>());
+        std::vector<std::pair<std::string, int32_t>> entries;
+        language.vocabulary->forEach([&](std::string_view word, int64_t id) { entries.emplace_back(std::string(word), int32_t(id)); });
+        contents.vocabulary = perfect_hash::build(entries);
+
+        size_t bytes = bundle::write(path, contents);
+        bundle::Bundle::open(path);
+        std::cout << "Packed " << CONFIG.modelPath << " and " << entries.size() << " words for " << contents.language
+            << " into " << bytes << " bytes: " << path << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
         return -1;
     }
+    return 0;
+}
+
+// Function to export the parameters and buffers of the --stemmer-lang model (or --bundle) into a
+// weight file for --weights-path; returns the process exit code
+int exportWeights(const std::string& path) {
+    try {
+        LanguageContext language;
+        language.profile = LanguageProfile{ CONFIG.modelPath, "", "", false, CONFIG.bundlePath, "" };
+        if (!CONFIG.bundlePath.empty()) language.bundle = bundle::Bundle::open(CONFIG.bundlePath);
+        loadModel(language);
+
+        std::vector<torch::Tensor> contiguous; // Keeps the exported data alive until written
+        std::vector<weight_file::Tensor> tensors;
+        std::set<std::string> names;
+        auto add = [&](const std::string& name, const torch::Tensor& tensor) {
+            if (!names.insert(name).second) throw std::runtime_error("Model has two tensors named " + name);
+            contiguous.push_back(tensor.contiguous());
+            const torch::Tensor& data = contiguous.back();
+            tensors.push_back({ name, int32_t(data.scalar_type()), data.sizes().vec(), data.data_ptr(), data.nbytes() });
+        };
+        for (const auto& parameter : language.model.named_parameters()) add(parameter.name, parameter.value);
+        for (const auto& buffer : language.model.named_buffers()) add(buffer.name, buffer.value);
+
+        size_t bytes = weight_file::write(path, modelHash(language), tensors);
+        weight_file::WeightFile::open(path, false);
+        std::cout << "Exported " << tensors.size() << " tensors in " << bytes << " bytes: " << path << std::endl;
+    }
     catch (const std::exception& e) {
         std::cerr << "Error: " << e.what() << std::endl;
         return -1;
     }
+    return 0;
+}
+
+// Function to check the built-in English stemmer against libstemmer on a word list, one word per
+// line, and compare the speed of both; returns the process exit code
+int verifyStemmer(const std::string& wordListPath) {
+    std::ifstream f(wordListPath);
+    if (!f) {
+        std::cerr << "Error: cannot open word list: " << wordListPath << std::endl;
+        return -1;
+    }
+    std::vector<std::string> words;
+    size_t skipped = 0;
+    for (std::string line; std::getline(f, line);) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (EnglishStemmer::supports(line)) words.push_back(line);
+        else skipped++;
+    }
+
+    StemmerPool pool("english", 1);
+    auto stemmer = pool.acquire();
+    std::vector<char> buffer;
+    size_t mismatches = 0;
+    for (const auto& word : words) {
+        ArenaScope arena;
+        ArenaString expected = stemWord(stemmer.get(), word);
+        buffer.resize(word.size());
+        std::string_view actual(buffer.data(), EnglishStemmer::stem(word, buffer.data()));
+        if (actual != std::string_view(expected) && mismatches++ < 20) {
+            std::cout << "Mismatch: " << word << " -> " << actual << ", libstemmer gives " << expected << std::endl;
+        }
+    }
+    std::cout << "Checked " << words.size() << " words (" << skipped << " non-ASCII skipped), " << mismatches << " mismatches" << std::endl;
+
+    // Time both stemmers the way tokenizeBatch calls them
+    auto timePerWord = [&](auto&& stem) {
+        auto begin = std::chrono::steady_clock::now();
+        for (const auto& word : words) {
+            ArenaScope arena;
+            volatile size_t length = stem(word).size(); // Keeps the stemming from being optimized out
+            (void)length;
+        }
+        auto elapsed = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - begin).count();
+        return words.empty() ? 0.0 : elapsed / words.size();
+    };
+    double libstemmerNs = timePerWord([&](const std::string& word) { return stemWord(stemmer.get(), word); });
+    double nativeNs = timePerWord([&](const std::string& word) {
+        ArenaString stemmed(word.size(), '\0');
+        stemmed.resize(EnglishStemmer::stem(word, stemmed.data()));
+        return stemmed;
+    });
+    std::cout << "libstemmer: " << libstemmerNs << " ns/word, built-in: " << nativeNs << " ns/word" << std::endl;
+    return mismatches == 0 ? 0 : 1;
+}
+
+// Function to print how shutdown went, once
+void printShutdownSummary() {
+    static std::atomic<bool> printed{ false };
+    if (printed.exchange(true)) return;
+    std::cout << "Shutdown summary: drained " << METRICS->requestsDrained << " requests, aborted " << METRICS->requestsInFlight << " requests" << std::endl;
+}
+
+// Function to reload the live settings of the configuration file
+void reloadConfig() {
+    if (CONFIG.configPath.empty()) {
+        std::cout << "No configuration file to reload" << std::endl;
+        return;
+    }
+    try {
+        auto changed = SETTINGS.applyFile(CONFIG.configPath, true);
+        std::cout << "Reloaded configuration from: " << CONFIG.configPath << " (" << changed.size() << " settings changed)" << std::endl;
+        for (const auto& name : changed) std::cout << "  " << name << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error reloading configuration, keeping the previous one: " << e.what() << std::endl;
+    }
+}
+
+// Function to reload the configuration file whenever its modification time changes
+void watchConfig() {
+    std::error_code error;
+    auto lastWrite = std::filesystem::last_write_time(CONFIG.configPath, error);
+    while (!waitForStop(std::chrono::milliseconds(CONFIG.configPollMs))) {
+        auto write = std::filesystem::last_write_time(CONFIG.configPath, error);
+        if (error || write == lastWrite) continue;
+        lastWrite = write;
+        reloadConfig();
+    }
+}
+
+// Function to handle signals until serving ends: SIGHUP reloads the configuration, while termination
+// signals withdraw readiness, stop accepting connections and let accepted requests finish within the
+// grace period
+void handleSignals(sigset_t signals, httplib::Server& server) {
+    int signal = 0;
+    while (true) {
+        if (waitForStop(std::chrono::milliseconds(0))) return;
+        timespec timeout{ 0, 100 * 1000 * 1000 };
+        signal = sigtimedwait(&signals, nullptr, &timeout);
+        if (signal == SIGHUP) reloadConfig();
+        else if (signal > 0) break;
+    }
+
+    auto gracePeriod = std::chrono::milliseconds(CONFIG.shutdownGraceMs.load());
+    std::cout << "Received signal " << signal << ", draining for up to " << gracePeriod.count() << " ms" << std::endl;
+    DRAINING = true;
+    server.stop();
+
+    // Wait for serve to finish draining, which it marks by stopping the background threads; a second
+    // termination signal or the deadline forces the exit
+    auto deadline = std::chrono::steady_clock::now() + gracePeriod;
+    while (std::chrono::steady_clock::now() < deadline) {
+        if (waitForStop(std::chrono::milliseconds(0))) return;
+        timespec timeout{ 0, 10 * 1000 * 1000 };
+        int received = sigtimedwait(&signals, nullptr, &timeout);
+        if (received > 0 && received != SIGHUP) break;
+    }
+
+    printShutdownSummary();
+    std::_Exit(1);
+}
+
+// Function to let the master and every worker of --workers bind the same port; the kernel spreads
+// incoming connections across their listening sockets
+void setReusePort(socket_t socket) {
+    int yes = 1;
+    setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&yes), sizeof(yes));
+    setsockopt(socket, SOL_SOCKET, SO_REUSEPORT, reinterpret_cast<const char*>(&yes), sizeof(yes));
+}
+
+// Function to create the HTTP server, bound before loading so liveness probes are answered while
+// resources load
+std::unique_ptr<httplib::Server> bindServer() {
+    auto server = std::make_unique<httplib::Server>();
+    server->new_task_queue = [] { return new httplib::ThreadPool(std::max(1, CONFIG.serverThreads)); };
+    if (CONFIG.workers > 0) server->set_socket_options(setReusePort);
 
     // Attach routes to the server
-    attachRoutes(server);
+    attachRoutes(*server);
+
+    if (!server->bind_to_port("0.0.0.0", CONFIG.port)) {
+        std::cerr << "Error: cannot bind to port " << CONFIG.port << std::endl;
+        return nullptr;
+    }
+    return server;
+}
+
+// Function to serve requests until shutdown, loading resources first unless a master of --workers
+// already did; returns the process exit code
+int serve(sigset_t signals, bool load, int worker) {
+    auto server = bindServer();
+    if (!server) return -1;
+
+    SCHEDULER.start();
+    // Joined before returning, so none of them outlives the globals they use
+    std::vector<std::thread> background;
+    background.emplace_back(handleSignals, signals, std::ref(*server));
+    if (!CONFIG.configPath.empty()) background.emplace_back(watchConfig);
+    if (!CONFIG.blocklistPath.empty() || !CONFIG.allowlistPath.empty()) background.emplace_back(watchHashLists);
+    // The master of --workers snapshots the cache its workers share
+    bool snapshots = worker == 0 && !CONFIG.cacheSnapshotPath.empty();
+    if (snapshots && CONFIG.cacheSnapshotIntervalS > 0) background.emplace_back(snapshotCachePeriodically);
+
+    // Stopping the server only takes once it runs, and it never will when listening failed
+    std::atomic<bool> listening{ true };
+    std::thread loader([&] {
+        if (!loadResources(load, true, worker)) {
+            STARTUP_FAILED = true;
+            while (listening && !server->is_running()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            server->stop();
+        }
+    });
 
     // Start the server
-    std::cout << "BlockTheTweet Server Is Running At Port " << port << "\n";
-    server.listen("0.0.0.0", port);
-}
\ No newline at end of file
+    if (worker > 0) std::cout << "BlockTheTweet Worker " << worker << " (pid " << getpid() << ") Is Running At Port " << CONFIG.port << "\n";
+    else std::cout << "BlockTheTweet Server Is Running At Port " << CONFIG.port << "\n";
+    bool listened = server->listen_after_bind();
+    listening = false;
+    if (!listened) std::cerr << "Error: cannot listen on port " << CONFIG.port << std::endl;
+    loader.join();
+    SCHEDULER.stop();
+    stopBackgroundThreads();
+    for (auto& thread : background) thread.join();
+
+    if (DRAINING) printShutdownSummary();
+    // The periodic snapshots have stopped, and the cache is only unmapped after main returns
+    if (snapshots && !STARTUP_FAILED) saveCacheSnapshot();
+    return STARTUP_FAILED || !listened ? -1 : 0;
+}
+
+// Function to run worker index of --workers in a freshly forked child; returns its exit code
+int runWorker(sigset_t signals, int index) {
+#if defined(__linux__)
+    // Exit with the master rather than keep serving unsupervised
+    pid_t master = getppid();
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    if (getppid() != master) return -1;
+#endif
+    METRICS = &PROCESS_METRICS[index];
+    sigset_t children;
+    sigemptyset(&children);
+    sigaddset(&children, SIGCHLD);
+    pthread_sigmask(SIG_UNBLOCK, &children, nullptr);
+
+    // Memory locks are not inherited across fork
+    try {
+        if (CONFIG.weightsLock) {
+            for (auto& language : LANGUAGES) {
+                if (language->weights) language->weights->lock();
+            }
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    return serve(signals, false, index);
+}
+
+// Struct to track one worker process of --workers
+struct WorkerProcess {
+    pid_t pid = 0; // 0 while not running
+    std::chrono::steady_clock::time_point started;
+    std::chrono::steady_clock::time_point restartAt; // When an exited worker is forked again
+};
+
+// Function to run the master of --workers: load every language once, fork workers that share its
+// memory copy-on-write and accept on their own SO_REUSEPORT sockets, then restart workers that exit
+// and forward signals to them; returns the process exit code
+int runWorkers(sigset_t signals) {
+    size_t count = size_t(CONFIG.workers);
+    try {
+        PROCESS_METRICS = std::span<Metrics>(mapSharedMetrics(count + 1), count + 1);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+    METRICS = &PROCESS_METRICS[0];
+
+    // Only the forking thread exists in a child, so the master's listener and loading threads must
+    // all have finished before the first fork; the port is closed until the workers bind it
+    {
+        auto server = bindServer();
+        if (!server) return -1;
+        std::atomic<bool> listening{ true };
+        bool listened = false;
+        std::thread listener([&] {
+            listened = server->listen_after_bind();
+            listening = false;
+        });
+        bool loaded = loadResources(true, false, 0);
+        while (listening && !server->is_running()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        server->stop();
+        listener.join();
+        if (!listened) std::cerr << "Error: cannot listen on port " << CONFIG.port << std::endl;
+        if (!loaded || !listened) return -1;
+    }
+
+    sigset_t supervised = signals;
+    sigaddset(&supervised, SIGCHLD);
+    pthread_sigmask(SIG_BLOCK, &supervised, nullptr);
+
+    std::vector<WorkerProcess> workers(count);
+    auto spawn = [&](size_t index) {
+        WorkerProcess& worker = workers[index];
+        std::cout.flush();
+        pid_t pid = fork();
+        if (pid == 0) std::exit(runWorker(signals, int(index + 1)));
+        worker.started = std::chrono::steady_clock::now();
+        if (pid < 0) {
+            std::cerr << "Error: cannot fork worker " << index + 1 << ": " << std::strerror(errno) << std::endl;
+            worker.restartAt = worker.started + std::chrono::seconds(1);
+            return;
+        }
+        worker.pid = pid;
+        METRICS->workers++;
+    };
+    for (size_t i = 0; i < count; i++) spawn(i);
+
+    bool draining = false;
+    auto lastSnapshot = std::chrono::steady_clock::now();
+    while (true) {
+        // Snapshotting here rather than on a thread keeps the master single-threaded for fork
+        if (CONFIG.cacheSnapshotIntervalS > 0 && std::chrono::steady_clock::now() - lastSnapshot >= std::chrono::seconds(CONFIG.cacheSnapshotIntervalS)) {
+            saveCacheSnapshot();
+            lastSnapshot = std::chrono::steady_clock::now();
+        }
+
+        // Reap exited workers, scheduling their restart unless shutting down
+        int status = 0;
+        pid_t pid;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            auto worker = std::find_if(workers.begin(), workers.end(), [&](const WorkerProcess& w) { return w.pid == pid; });
+            if (worker == workers.end()) continue;
+            size_t index = worker - workers.begin();
+            worker->pid = 0;
+            METRICS->workers--;
+            resetGauges(PROCESS_METRICS[index + 1]);
+            if (draining) continue;
+
+            auto now = std::chrono::steady_clock::now();
+            std::cerr << "Worker " << index + 1 << " (pid " << pid << ") "
+                << (WIFSIGNALED(status) ? "was killed by signal " + std::to_string(WTERMSIG(status)) : "exited with status " + std::to_string(WEXITSTATUS(status)))
+                << ", restarting" << std::endl;
+            METRICS->workerRestarts++;
+            // A worker failing right after it started is likely to fail again, so it is restarted after a pause
+            worker->restartAt = now - worker->started < std::chrono::seconds(1) ? now + std::chrono::seconds(1) : now;
+        }
+
+        bool running = std::any_of(workers.begin(), workers.end(), [](const WorkerProcess& w) { return w.pid != 0; });
+        if (draining && !running) break;
+        if (!draining) {
+            auto now = std::chrono::steady_clock::now();
+            for (size_t i = 0; i < count; i++) {
+                if (workers[i].pid == 0 && workers[i].restartAt <= now) spawn(i);
+            }
+        }
+
+        timespec timeout{ 0, 100 * 1000 * 1000 };
+        int signal = sigtimedwait(&supervised, nullptr, &timeout);
+        if (signal == SIGHUP) {
+            // Workers forked later start from the master's configuration
+            reloadConfig();
+        }
+        else if (signal == SIGTERM || signal == SIGINT) {
+            if (!draining) std::cout << "Received signal " << signal << ", stopping " << count << " workers" << std::endl;
+            draining = true;
+        }
+        else {
+            continue;
+        }
+        // Workers drain on the first termination signal and exit at once on the second
+        for (const auto& worker : workers) {
+            if (worker.pid != 0) kill(worker.pid, signal);
+        }
+    }
+
+    std::cout << "All workers stopped" << std::endl;
+    saveCacheSnapshot();
+    return 0;
+}
+
+// Main function
+int main(int argc, char* argv[]) {
+    // Declare command-line arguments; every tunable can also be set in the configuration file
+    OPTIONS.add_options()
+        ("c,config", "Path to a JSON configuration file whose keys are the long option names", cxxopts::value<std::string>())
+        ("compile-fst", "Compile the word index and a list of surface words into the word FST at --fst-path, then exit", cxxopts::value<std::string>())
+        ("pack-bundle", "Pack the model, word index, stemmer language and max length into the bundle at the given path, then exit", cxxopts::value<std::string>())
+        ("export-weights", "Export the model's parameters into a weight file for --weights-path at the given path, then exit", cxxopts::value<std::string>())
+        ("verify-stemmer", "Compare the built-in English stemmer with libstemmer on a word list, then exit", cxxopts::value<std::string>())
+        ("h,help", "Print usage");
+    SETTINGS.add("config-poll-ms", "Interval between checks of the configuration file for changes", CONFIG.configPollMs);
+    SETTINGS.add("m,model-path", "Path to the model file", CONFIG.modelPath);
+    SETTINGS.add("w,word-index-path", "Path to word index JSON file", CONFIG.wordIndexPath);
+    SETTINGS.add("embedded-vocabulary", "Use the word index compiled into the binary instead of --word-index-path", CONFIG.embeddedVocabulary);
+    SETTINGS.add("bundle", "Path to a bundle from --pack-bundle, replacing the model, word index and stemmer language", CONFIG.bundlePath);
+    SETTINGS.add("max-length", "Tokens per model input row; bundles carry their own", CONFIG.maxLength);
+    SETTINGS.add("weights-path", "Path to a weight file from --export-weights; processes mapping it share the model's memory", CONFIG.weightsPath);
+    SETTINGS.add("weights-populate", "Fault the whole weight file in at startup (MAP_POPULATE, MADV_WILLNEED)", CONFIG.weightsPopulate);
+    SETTINGS.add("weights-lock", "Lock the weight file in memory with mlock so inference never page-faults", CONFIG.weightsLock);
+    SETTINGS.add("s,stemmer-lang", "Stemmer language", CONFIG.stemmerLang);
+    SETTINGS.add("native-stemmer", "Stem ASCII words with the built-in stemmer when the language is English", CONFIG.nativeStemmer);
+    SETTINGS.add("fst-path", "Path to a word FST from --compile-fst, mapping surface words straight to token ids", CONFIG.fstPath);
+    SETTINGS.addJson("languages", "Additional languages by stemmer name, each with model-path and word-index-path or bundle-path, and optional fst-path, weights-path and embedded-vocabulary", CONFIG.languages);
+    SETTINGS.add("p,port", "Port to run the server on", CONFIG.port);
+    SETTINGS.add("server-threads", "Number of HTTP worker threads", CONFIG.serverThreads);
+    SETTINGS.add("workers", "Number of worker processes forked after loading, sharing the model and vocabulary; 0 serves from this process", CONFIG.workers);
+    SETTINGS.add("intra-op-threads", "Number of libtorch intra-op threads, 0 for the libtorch default", CONFIG.intraOpThreads);
+    SETTINGS.add("inter-op-threads", "Number of libtorch inter-op threads, 0 for the libtorch default", CONFIG.interOpThreads);
+    SETTINGS.add("allocator-option", "Allocator tuning option as name=value, may be repeated", CONFIG.allocatorOptions);
+    SETTINGS.add("warmup-iterations", "Number of warmup predictions run before reporting ready", CONFIG.warmupIterations);
+    SETTINGS.add("warmup-texts-path", "File of recent texts, one per line and most frequent first, predicted into the prediction cache before reporting ready", CONFIG.warmupTextsPath);
+    SETTINGS.add("warmup-texts-limit", "Number of lines of --warmup-texts-path to predict, 0 for all", CONFIG.warmupTextsLimit);
+    SETTINGS.add("shutdown-grace-ms", "Time allowed for accepted requests to finish after SIGTERM", CONFIG.shutdownGraceMs);
+    SETTINGS.add("concurrency-limit", "Reject requests with 429 beyond an adaptive concurrency limit; off by default, set --concurrency-target-ms to the latency the model should keep", CONFIG.limiter.enabled);
+    SETTINGS.add("concurrency-target-ms", "Mean inference latency the concurrency limit keeps below", CONFIG.limiter.targetLatencyMs);
+    SETTINGS.add("concurrency-initial-limit", "Concurrency limit before any latency has been measured", CONFIG.limiter.initialLimit);
+    SETTINGS.add("concurrency-min-limit", "Lower bound of the concurrency limit", CONFIG.limiter.minLimit);
+    SETTINGS.add("concurrency-max-limit", "Upper bound of the concurrency limit", CONFIG.limiter.maxLimit);
+    SETTINGS.add("concurrency-backoff", "Factor applied to the limit when a window exceeds the target latency", CONFIG.limiter.backoffRatio);
+    SETTINGS.add("concurrency-window-ms", "Length of the window over which latency is averaged", CONFIG.limiter.windowMs);
+    SETTINGS.add("client-header", "Request header identifying the client; clients without it are identified by address", CONFIG.clientHeader);
+    SETTINGS.add("rate-limit-rps", "Requests per second allowed per client, 0 to disable; --workers take from the same buckets", CONFIG.rateLimit.ratePerSecond);
+    SETTINGS.add("rate-limit-burst", "Requests a client may send at once before its rate applies", CONFIG.rateLimit.burst);
+    SETTINGS.add("rate-limit-max-clients", "Number of clients tracked at once; a new client beyond it takes over the bucket closest to refilled", CONFIG.rateLimit.maxClients);
+    SETTINGS.add("single-flight", "Share one prediction between identical texts arriving concurrently", CONFIG.singleFlight);
+    SETTINGS.add("prediction-cache-mb", "Size of the prediction cache shared by worker processes, 0 to disable", CONFIG.predictionCacheMb);
+    SETTINGS.add("prediction-cache-path", "File (e.g. under /dev/shm) holding the prediction cache, shared by every process opening it; empty keeps it private to this process and its workers", CONFIG.predictionCachePath);
+    SETTINGS.add("cache-snapshot-path", "File the prediction cache is snapshotted to periodically and at shutdown, and loaded from at startup", CONFIG.cacheSnapshotPath);
+    SETTINGS.add("cache-snapshot-interval-s", "Seconds between prediction cache snapshots, 0 for only at shutdown", CONFIG.cacheSnapshotIntervalS);
+    SETTINGS.add("blocklist-path", "File of texts answered with confidence 1 without inference, one per line or as xxh64:<hex hash>; reloaded when it changes", CONFIG.blocklistPath);
+    SETTINGS.add("allowlist-path", "File of texts answered with confidence 0 without inference, in the format of --blocklist-path", CONFIG.allowlistPath);
+    SETTINGS.add("cluster-peers", "Instance as host:port, repeated for every instance of the cluster including this one; texts are routed to an owner by consistent hashing", CONFIG.clusterPeers);
+    SETTINGS.add("cluster-self", "This instance's entry of --cluster-peers", CONFIG.clusterSelf);
+    SETTINGS.add("cluster-secret", "Secret shared by the cluster peers, marking forwarded requests, which skip rate limiting; required with --cluster-peers", CONFIG.clusterSecret);
+    SETTINGS.add("peer-timeout-ms", "Time a forwarded request may take before the text is predicted locally", CONFIG.peerTimeoutMs);
+    SETTINGS.add("peer-retry-ms", "Time a failing peer's texts are predicted locally before it is tried again", CONFIG.peerRetryMs);
+    SETTINGS.add("inference-threads", "Number of threads running inference batches", CONFIG.scheduler.threads);
+    SETTINGS.add("batch-size", "Maximum number of texts per forward pass; raise it for models accepting batches", CONFIG.scheduler.batchSize);
+    SETTINGS.add("batch-wait-us", "Time a partial batch waits for more texts", CONFIG.scheduler.batchWaitUs);
+    SETTINGS.add("max-queue-per-client", "Texts a client may have waiting before it gets 429; with --workers each worker queues and counts its own", CONFIG.scheduler.maxQueuePerClient);
+    SETTINGS.add("client-weights", "Scheduling weight per client id (key:<api key> or ip:<address>), default 1; with --workers each worker shares its own inference threads by them", CONFIG.scheduler.clientWeights);
+
+    try {
+        // Parse command-line arguments, then let the configuration file fill in what they did not set
+        auto result = OPTIONS.parse(argc, argv);
+
+        if (result.count("help")) {
+            std::cout << OPTIONS.help() << std::endl;
+            return 0;
+        }
+
+        SETTINGS.applyCli(result);
+        if (result.count("config")) {
+            CONFIG.configPath = result["config"].as<std::string>();
+            SETTINGS.applyFile(CONFIG.configPath, false);
+            std::cout << "Loaded configuration from: " << CONFIG.configPath << std::endl;
+        }
+
+        if (result.count("compile-fst")) {
+            return compileWordFst(result["compile-fst"].as<std::string>());
+        }
+        if (result.count("pack-bundle")) {
+            return packBundle(result["pack-bundle"].as<std::string>());
+        }
+        if (result.count("export-weights")) {
+            return exportWeights(result["export-weights"].as<std::string>());
+        }
+        if (result.count("verify-stemmer")) {
+            return verifyStemmer(result["verify-stemmer"].as<std::string>());
+        }
+
+        // Tune the allocator before the large allocations of loading happen
+        for (const auto& option : CONFIG.allocatorOptions) {
+            applyAllocatorOption(option);
+            std::cout << "Applied " << allocatorName() << " option: " << option << std::endl;
+        }
+
+        configureLanguages();
+        configureCluster();
+        if (!CONFIG.blocklistPath.empty()) loadHashList(BLOCKLIST, CONFIG.blocklistPath, "blocklist");
+        if (!CONFIG.allowlistPath.empty()) loadHashList(ALLOWLIST, CONFIG.allowlistPath, "allowlist");
+
+        // Mapped before --workers forks so every worker shares them
+        RATE_LIMITER = RateLimiter::open(CONFIG.rateLimit, size_t(std::max(1, CONFIG.rateLimit.maxClients)));
+        if (CONFIG.predictionCacheMb > 0) {
+            PREDICTION_CACHE = PredictionCache::open(CONFIG.predictionCachePath, size_t(CONFIG.predictionCacheMb) << 20);
+            std::cout << "Mapped prediction cache" << (CONFIG.predictionCachePath.empty() ? "" : " from: " + CONFIG.predictionCachePath)
+                << " (" << PREDICTION_CACHE->capacity() << " entries)" << std::endl;
+        }
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return -1;
+    }
+
+    // Block handled signals in every thread; a dedicated thread waits for them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGTERM);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    if (CONFIG.workers > 0) return runWorkers(signals);
+    return serve(signals, true, 0);
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <sys/mman.h>
+
+// Counters and gauges exported on /metrics; plain atomics so the struct stays trivially shareable
+struct Metrics {
+    std::atomic<int64_t> requests{ 0 };
+    std::atomic<int64_t> requestsInFlight{ 0 };
+    std::atomic<int64_t> requestsDrained{ 0 };
+    std::atomic<int64_t> coalesced{ 0 };
+    std::atomic<int64_t> rateLimited{ 0 };
+    std::atomic<int64_t> queueRejected{ 0 };
+    std::atomic<int64_t> queuedJobs{ 0 };
+    std::atomic<int64_t> batches{ 0 };
+    std::atomic<int64_t> batchedJobs{ 0 };
+    std::atomic<int64_t> concurrencyRejected{ 0 };
+    std::atomic<int64_t> concurrencyLimit{ 0 };
+    std::atomic<int64_t> inferenceInFlight{ 0 };
+    std::atomic<int64_t> inferenceCompleted{ 0 };
+    std::atomic<int64_t> inferenceLatencyNs{ 0 };
+    std::atomic<int64_t> tokens{ 0 };
+    std::atomic<int64_t> tokenizeLatencyNs{ 0 };
+    std::atomic<int64_t> forwardCompleted{ 0 };
+    std::atomic<int64_t> forwardLatencyNs{ 0 };
+    std::atomic<int64_t> workers{ 0 };
+    std::atomic<int64_t> workerRestarts{ 0 };
+    std::atomic<int64_t> predictionCacheHits{ 0 };
+    std::atomic<int64_t> predictionCacheMisses{ 0 };
+    std::atomic<int64_t> predictionCacheInserts{ 0 };
+    std::atomic<int64_t> predictionCacheEvictions{ 0 };
+    std::atomic<int64_t> peerForwarded{ 0 };
+    std::atomic<int64_t> peerFallbacks{ 0 };
+    std::atomic<int64_t> peerReceived{ 0 };
+    std::atomic<int64_t> blocklistHits{ 0 };
+    std::atomic<int64_t> allowlistHits{ 0 };
+};
+
+// Processes of --workers update their own Metrics in shared memory, which only works lock-free
+static_assert(std::atomic<int64_t>::is_always_lock_free);
+
+// Struct to describe how a Metrics member is exported
+struct MetricInfo {
+    const char* name;
+    const char* type;
+    const char* help;
+    std::atomic<int64_t> Metrics::* member;
+    double scale;
+};
+
+inline const MetricInfo METRIC_INFO[] = {
+    {"blockthetweet_requests_total", "counter", "Classification requests received", &Metrics::requests, 1},
+    {"blockthetweet_requests_in_flight", "gauge", "Classification requests being handled", &Metrics::requestsInFlight, 1},
+    {"blockthetweet_requests_drained_total", "counter", "Classification requests completed while shutting down", &Metrics::requestsDrained, 1},
+    {"blockthetweet_coalesced_total", "counter", "Requests answered with the prediction of an identical concurrent request", &Metrics::coalesced, 1},
+    {"blockthetweet_rate_limited_total", "counter", "Requests rejected with 429 by their client's rate limit", &Metrics::rateLimited, 1},
+    {"blockthetweet_queue_rejected_total", "counter", "Requests rejected with 429 because their client's queue was full", &Metrics::queueRejected, 1},
+    {"blockthetweet_queued_jobs", "gauge", "Texts waiting in the scheduler", &Metrics::queuedJobs, 1},
+    {"blockthetweet_batches_total", "counter", "Inference batches run", &Metrics::batches, 1},
+    {"blockthetweet_batched_jobs_total", "counter", "Texts predicted in inference batches", &Metrics::batchedJobs, 1},
+    {"blockthetweet_concurrency_rejected_total", "counter", "Requests rejected with 429 by the adaptive concurrency limit", &Metrics::concurrencyRejected, 1},
+    {"blockthetweet_concurrency_limit", "gauge", "Current adaptive concurrency limit, 0 while it is off", &Metrics::concurrencyLimit, 1},
+    {"blockthetweet_inference_in_flight", "gauge", "Requests admitted past the concurrency limit", &Metrics::inferenceInFlight, 1},
+    {"blockthetweet_inference_completed_total", "counter", "Requests that completed inference", &Metrics::inferenceCompleted, 1},
+    {"blockthetweet_inference_latency_seconds_total", "counter", "Time from admission to inference result, summed", &Metrics::inferenceLatencyNs, 1e-9},
+    {"blockthetweet_tokens_total", "counter", "Words tokenized for inference", &Metrics::tokens, 1},
+    {"blockthetweet_tokenize_latency_seconds_total", "counter", "Time spent tokenizing inference batches, summed", &Metrics::tokenizeLatencyNs, 1e-9},
+    {"blockthetweet_forward_completed_total", "counter", "Model forward passes", &Metrics::forwardCompleted, 1},
+    {"blockthetweet_forward_latency_seconds_total", "counter", "Time spent in model forward passes, summed", &Metrics::forwardLatencyNs, 1e-9},
+    {"blockthetweet_workers", "gauge", "Worker processes running in --workers mode", &Metrics::workers, 1},
+    {"blockthetweet_worker_restarts_total", "counter", "Worker processes restarted after exiting unexpectedly", &Metrics::workerRestarts, 1},
+    {"blockthetweet_prediction_cache_hits_total", "counter", "Requests answered from the prediction cache", &Metrics::predictionCacheHits, 1},
+    {"blockthetweet_prediction_cache_misses_total", "counter", "Requests not found in the prediction cache", &Metrics::predictionCacheMisses, 1},
+    {"blockthetweet_prediction_cache_inserts_total", "counter", "Predictions stored in the prediction cache", &Metrics::predictionCacheInserts, 1},
+    {"blockthetweet_prediction_cache_evictions_total", "counter", "Predictions evicted from the prediction cache to make room", &Metrics::predictionCacheEvictions, 1},
+    {"blockthetweet_peer_forwarded_total", "counter", "Requests answered by the cluster peer owning their text", &Metrics::peerForwarded, 1},
+    {"blockthetweet_peer_fallbacks_total", "counter", "Requests predicted locally because the owning peer failed or timed out", &Metrics::peerFallbacks, 1},
+    {"blockthetweet_peer_received_total", "counter", "Requests forwarded here by cluster peers", &Metrics::peerReceived, 1},
+    {"blockthetweet_blocklist_hits_total", "counter", "Requests answered from the blocklist without inference", &Metrics::blocklistHits, 1},
+    {"blockthetweet_allowlist_hits_total", "counter", "Requests answered from the allowlist without inference", &Metrics::allowlistHits, 1},
+};
+
+// Function to map zeroed metrics for count processes into memory that stays shared across fork
+inline Metrics* mapSharedMetrics(size_t count) {
+    void* memory = mmap(nullptr, count * sizeof(Metrics), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) throw std::runtime_error(std::string("Cannot map shared metrics: ") + std::strerror(errno));
+    auto metrics = static_cast<Metrics*>(memory);
+    for (size_t i = 0; i < count; i++) new (&metrics[i]) Metrics();
+    return metrics;
+}
+
+// Function to zero the gauges of a process that exited, whose last values no longer hold; its
+// counters stay so the sums exported keep increasing
+inline void resetGauges(Metrics& metrics) {
+    for (const auto& info : METRIC_INFO) {
+        if (std::strcmp(info.type, "gauge") == 0) (metrics.*info.member).store(0, std::memory_order_relaxed);
+    }
+}
+
+// Function to render the sum of the metrics of count processes in the Prometheus text exposition format
+inline std::string renderMetrics(const Metrics* metrics, size_t count) {
+    std::ostringstream out;
+    for (const auto& info : METRIC_INFO) {
+        out << "# HELP " << info.name << " " << info.help << "\n";
+        out << "# TYPE " << info.name << " " << info.type << "\n";
+        int64_t value = 0;
+        for (size_t i = 0; i < count; i++) value += (metrics[i].*info.member).load(std::memory_order_relaxed);
+        if (info.scale == 1) out << info.name << " " << value << "\n";
+        else out << info.name << " " << value * info.scale << "\n";
+    }
+    return out.str();
+}
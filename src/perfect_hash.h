@@ -0,0 +1,113 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "../libs/xxhash/xxhash.h"
+
+// Minimal perfect hashing by per-bucket pilots (PTHash): a key's 64-bit hash picks a bucket, and
+// the bucket's pilot, chosen at build time, moves every key of the bucket to a distinct free slot.
+// Shared by the builders (tools/gen_vocabulary, --pack-bundle) and PerfectHashVocabulary.
+namespace perfect_hash {
+
+// Average number of keys per bucket; more keys per bucket means fewer pilots but a longer search
+inline constexpr uint32_t KEYS_PER_BUCKET = 4;
+
+inline constexpr uint32_t bucketCount(uint32_t keyCount) {
+    return keyCount / KEYS_PER_BUCKET + 1;
+}
+
+inline constexpr uint32_t bucketOf(uint64_t hash, uint32_t buckets) {
+    return uint32_t((hash >> 32) % buckets);
+}
+
+// Function to scramble 64 bits (splitmix64 finalizer)
+inline constexpr uint64_t mix(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xBF58476D1CE4E5B9ull;
+    value ^= value >> 27;
+    value *= 0x94D049BB133111EBull;
+    return value ^ (value >> 31);
+}
+
+// The hash and pilot are mixed again after combining them: a plain XOR keeps the low bits of two
+// keys equal or different whatever the pilot, so keys of a bucket sharing them would never separate
+// in a table of a power of two slots
+inline constexpr uint32_t slotOf(uint64_t hash, uint32_t pilot, uint32_t slots) {
+    return uint32_t(mix(hash ^ mix(pilot)) % slots);
+}
+
+inline uint64_t hashOf(std::string_view key) {
+    return XXH64(key.data(), key.size(), 0);
+}
+
+// Struct to hold a built table: keys, offsets (one more than keys) and ids are in slot order
+struct Table {
+    std::vector<uint32_t> pilots;
+    std::vector<uint32_t> offsets{ 0 };
+    std::vector<int32_t> ids;
+    std::string keys;
+};
+
+// Function to build the table of (key, id) pairs. Buckets are placed largest first, each with the
+// smallest pilot that moves all of its keys to free slots.
+inline Table build(const std::vector<std::pair<std::string, int32_t>>& entries) {
+    constexpr uint32_t maxPilot = 1u << 24;
+    uint32_t slots = uint32_t(entries.size());
+    uint32_t buckets = bucketCount(slots);
+
+    std::vector<uint64_t> hashes;
+    std::unordered_set<uint64_t> seen;
+    std::vector<std::vector<uint32_t>> members(buckets);
+    for (uint32_t key = 0; key < slots; key++) {
+        hashes.push_back(hashOf(entries[key].first));
+        if (!seen.insert(hashes[key]).second) throw std::runtime_error("Two keys share the hash of " + entries[key].first);
+        members[bucketOf(hashes[key], buckets)].push_back(key);
+    }
+
+    std::vector<uint32_t> order(buckets);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return members[a].size() > members[b].size(); });
+
+    Table table;
+    table.pilots.assign(buckets, 0);
+    std::vector<uint32_t> slotKey(slots, UINT32_MAX);
+    std::vector<uint32_t> taken;
+    for (uint32_t bucket : order) {
+        if (members[bucket].empty()) break;
+        bool placed = false;
+        for (uint32_t pilot = 0; pilot < maxPilot && !placed; pilot++) {
+            taken.clear();
+            placed = true;
+            for (uint32_t key : members[bucket]) {
+                uint32_t slot = slotOf(hashes[key], pilot, slots);
+                if (slotKey[slot] != UINT32_MAX || std::find(taken.begin(), taken.end(), slot) != taken.end()) {
+                    placed = false;
+                    break;
+                }
+                taken.push_back(slot);
+            }
+            if (placed) {
+                table.pilots[bucket] = pilot;
+                for (size_t i = 0; i < taken.size(); i++) slotKey[taken[i]] = members[bucket][i];
+            }
+        }
+        if (!placed) throw std::runtime_error("No perfect hash pilot found for a bucket");
+    }
+
+    for (uint32_t key : slotKey) {
+        table.keys.append(entries[key].first);
+        if (table.keys.size() > UINT32_MAX) throw std::length_error("Perfect hash keys exceed 4 GiB");
+        table.offsets.push_back(uint32_t(table.keys.size()));
+        table.ids.push_back(entries[key].second);
+    }
+    return table;
+}
+
+}
@@ -0,0 +1,289 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../libs/xxhash/xxhash.h"
+
+// Confidences of predicted texts by 64-bit key (text hash mixed with the language's salt), in memory
+// that every process on a host can map: anonymous memory inherited by --workers children, or a file
+// (e.g. under /dev/shm) that unrelated processes open by path. The table is set associative with a
+// fixed size. Nothing locks: a slot's sequence number is odd while it is written, and readers that
+// see it odd or changed treat the lookup as a miss. Each set evicts by CLOCK, with a reference bit
+// per way that hits set and the sweeping hand clears. Snapshots copy the entries to a file tagged
+// with the models they were predicted by, to refill the cache after a restart.
+class PredictionCache {
+public:
+    static constexpr uint32_t WAYS = 7; // A set with its CLOCK state fills two cache lines
+    static constexpr uint32_t VERSION = 1;
+    static constexpr char MAGIC[8] = { 'B', 'T', 'T', 'P', 'C', 'C', 'H', '\0' };
+
+    // Key 0 marks a free slot, so keys are never 0
+    struct Slot {
+        std::atomic<uint32_t> sequence; // Odd while the slot is being written
+        std::atomic<float> confidence;
+        std::atomic<uint64_t> key;
+    };
+
+    struct alignas(64) Set {
+        std::atomic<uint32_t> referenced; // CLOCK reference bit per way
+        std::atomic<uint32_t> hand; // Next way the CLOCK hand looks at
+        Slot slots[WAYS];
+    };
+
+    // Zero bytes are valid empty slots, so the mapping needs no construction, even when another
+    // process created it
+    static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free && std::atomic<float>::is_always_lock_free);
+    static_assert(sizeof(Set) == 128);
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t ways;
+        uint64_t setCount;
+    };
+    static constexpr size_t HEADER_SIZE = 64; // Sets start on a cache line boundary
+
+    // Snapshot file layout: header, keys, confidences
+    static constexpr char SNAPSHOT_MAGIC[8] = { 'B', 'T', 'T', 'C', 'S', 'N', 'P', '\0' };
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t tag; // Identifies the models the confidences were predicted by
+        uint64_t entryCount;
+        uint64_t checksum; // XXH64 of the keys and confidences
+    };
+
+    // Function to map a cache of at most bytes; with a path, the file is created or, if another
+    // process created it, joined, and must then have the same size
+    static std::unique_ptr<PredictionCache> open(const std::string& path, size_t bytes) {
+        if (bytes < HEADER_SIZE + sizeof(Set)) throw std::invalid_argument("Prediction cache is smaller than one set");
+        uint64_t setCount = (bytes - HEADER_SIZE) / sizeof(Set);
+        size_t size = HEADER_SIZE + setCount * sizeof(Set);
+
+        if (path.empty()) {
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            if (data == MAP_FAILED) throw std::runtime_error(std::string("Cannot map prediction cache: ") + std::strerror(errno));
+            initialize(data, setCount);
+            return std::unique_ptr<PredictionCache>(new PredictionCache(path, data, size));
+        }
+
+        int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0600);
+        if (fd < 0) throw std::runtime_error("Cannot open prediction cache: " + path);
+        // Serializes creation with the other processes opening the file
+        flock(fd, LOCK_EX);
+        struct stat info;
+        bool created = fstat(fd, &info) == 0 && info.st_size == 0;
+        if (created && ftruncate(fd, size) != 0) {
+            ::close(fd);
+            throw std::runtime_error("Cannot size prediction cache: " + path);
+        }
+        if (!created && size_t(info.st_size) != size) {
+            ::close(fd);
+            throw std::runtime_error("Prediction cache " + path + " has a different size, remove it or configure the same size");
+        }
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (data != MAP_FAILED && created) initialize(data, setCount);
+        ::close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("Cannot map prediction cache: " + path);
+
+        const Header& header = *static_cast<const Header*>(data);
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION || header.ways != WAYS || header.setCount != setCount) {
+            munmap(data, size);
+            throw std::runtime_error("Not a prediction cache of version " + std::to_string(VERSION) + ": " + path);
+        }
+        return std::unique_ptr<PredictionCache>(new PredictionCache(path, data, size));
+    }
+
+    ~PredictionCache() { munmap(data, size); }
+
+    PredictionCache(const PredictionCache&) = delete;
+    PredictionCache& operator=(const PredictionCache&) = delete;
+
+    // Function to look a key up; a slot being written counts as a miss rather than being waited for
+    bool lookup(uint64_t key, float& confidence) {
+        key = key ? key : 1;
+        Set& set = setOf(key);
+        for (uint32_t way = 0; way < WAYS; way++) {
+            if (set.slots[way].key.load(std::memory_order_relaxed) != key) continue;
+            uint64_t read;
+            float value;
+            if (!readSlot(set.slots[way], read, value) || read != key) return false;
+
+            // Written only when unset, so hot sets do not bounce between cores
+            uint32_t bit = 1u << way;
+            if (!(set.referenced.load(std::memory_order_relaxed) & bit)) set.referenced.fetch_or(bit, std::memory_order_relaxed);
+            confidence = value;
+            return true;
+        }
+        return false;
+    }
+
+    // Function to store a key's confidence, in its own slot, a free one or the CLOCK victim; returns
+    // true when another key was evicted. The store is dropped if another writer holds the slot.
+    bool insert(uint64_t key, float confidence) {
+        key = key ? key : 1;
+        Set& set = setOf(key);
+        int32_t way = -1;
+        for (uint32_t i = 0; i < WAYS; i++) {
+            uint64_t current = set.slots[i].key.load(std::memory_order_relaxed);
+            if (current == key) {
+                way = int32_t(i);
+                break;
+            }
+            if (current == 0 && way < 0) way = int32_t(i);
+        }
+        // Ways referenced since the hand last passed get a second chance; after one full turn every
+        // bit is cleared, so a victim is found within two
+        for (uint32_t step = 0; way < 0 && step < 2 * WAYS; step++) {
+            uint32_t candidate = set.hand.fetch_add(1, std::memory_order_relaxed) % WAYS;
+            uint32_t bit = 1u << candidate;
+            if (!(set.referenced.fetch_and(~bit, std::memory_order_relaxed) & bit)) way = int32_t(candidate);
+        }
+        if (way < 0) way = int32_t(set.hand.load(std::memory_order_relaxed) % WAYS);
+
+        Slot& slot = set.slots[way];
+        uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        if ((sequence & 1) || !slot.sequence.compare_exchange_strong(sequence, sequence + 1, std::memory_order_acquire, std::memory_order_relaxed)) {
+            return false;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        uint64_t previous = slot.key.load(std::memory_order_relaxed);
+        slot.key.store(key, std::memory_order_relaxed);
+        slot.confidence.store(confidence, std::memory_order_relaxed);
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        set.referenced.fetch_or(1u << way, std::memory_order_relaxed);
+        return previous != 0 && previous != key;
+    }
+
+    // Function to count the occupied slots by scanning every set
+    size_t entries() const {
+        size_t count = 0;
+        for (uint64_t i = 0; i < setCount; i++) {
+            for (const Slot& slot : sets[i].slots) count += slot.key.load(std::memory_order_relaxed) != 0;
+        }
+        return count;
+    }
+
+    // Function to write every entry to a snapshot file, replacing it atomically; returns the entry count
+    size_t save(const std::string& path, uint64_t tag) const {
+        std::vector<uint64_t> keys;
+        std::vector<float> confidences;
+        for (uint64_t i = 0; i < setCount; i++) {
+            for (const Slot& slot : sets[i].slots) {
+                uint64_t key;
+                float confidence;
+                if (readSlot(slot, key, confidence) && key != 0) {
+                    keys.push_back(key);
+                    confidences.push_back(confidence);
+                }
+            }
+        }
+
+        SnapshotHeader header{};
+        std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        header.version = VERSION;
+        header.tag = tag;
+        header.entryCount = keys.size();
+        header.checksum = XXH64(confidences.data(), confidences.size() * sizeof(float), XXH64(keys.data(), keys.size() * sizeof(uint64_t), 0));
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out.write(reinterpret_cast<const char*>(keys.data()), keys.size() * sizeof(uint64_t));
+            out.write(reinterpret_cast<const char*>(confidences.data()), confidences.size() * sizeof(float));
+            if (!out.flush()) throw std::runtime_error("Cannot write prediction cache snapshot: " + temporary);
+        }
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) throw std::runtime_error("Cannot replace prediction cache snapshot: " + path);
+        return keys.size();
+    }
+
+    // Function to insert every entry of a snapshot file taken with the same tag, mapped and read
+    // sequentially; returns the entry count
+    size_t load(const std::string& path, uint64_t tag) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open prediction cache snapshot: " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(SnapshotHeader)) {
+            ::close(fd);
+            throw std::runtime_error("Prediction cache snapshot is truncated: " + path);
+        }
+        void* file = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (file == MAP_FAILED) throw std::runtime_error("Cannot map prediction cache snapshot: " + path);
+        madvise(file, info.st_size, MADV_SEQUENTIAL);
+        std::unique_ptr<void, std::function<void(void*)>> unmap(file, [&](void* p) { munmap(p, info.st_size); });
+
+        const SnapshotHeader& header = *static_cast<const SnapshotHeader*>(file);
+        if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 || header.version != VERSION) {
+            throw std::runtime_error("Not a prediction cache snapshot of version " + std::to_string(VERSION) + ": " + path);
+        }
+        if (header.tag != tag) throw std::runtime_error("Prediction cache snapshot was taken with different models: " + path);
+        size_t count = header.entryCount;
+        if ((size_t(info.st_size) - sizeof(SnapshotHeader)) / (sizeof(uint64_t) + sizeof(float)) != count
+            || (size_t(info.st_size) - sizeof(SnapshotHeader)) % (sizeof(uint64_t) + sizeof(float)) != 0) {
+            throw std::runtime_error("Prediction cache snapshot is truncated: " + path);
+        }
+        auto keys = reinterpret_cast<const uint64_t*>(static_cast<const char*>(file) + sizeof(SnapshotHeader));
+        auto confidences = reinterpret_cast<const float*>(keys + count);
+        if (XXH64(confidences, count * sizeof(float), XXH64(keys, count * sizeof(uint64_t), 0)) != header.checksum) {
+            throw std::runtime_error("Prediction cache snapshot checksum mismatch: " + path);
+        }
+        for (size_t i = 0; i < count; i++) insert(keys[i], confidences[i]);
+        return count;
+    }
+
+    size_t capacity() const { return setCount * WAYS; }
+    size_t bytes() const { return size; }
+    const std::string& path() const { return filePath; }
+
+private:
+    PredictionCache(const std::string& path, void* data, size_t size)
+        : filePath(path), data(data), size(size), setCount(static_cast<const Header*>(data)->setCount),
+        sets(reinterpret_cast<Set*>(static_cast<char*>(data) + HEADER_SIZE)) {}
+
+    static void initialize(void* data, uint64_t setCount) {
+        Header& header = *static_cast<Header*>(data);
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.ways = WAYS;
+        header.setCount = setCount;
+    }
+
+    // Function to read a slot consistently; false if it is being written
+    static bool readSlot(const Slot& slot, uint64_t& key, float& confidence) {
+        uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        key = slot.key.load(std::memory_order_relaxed);
+        confidence = slot.confidence.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return !(before & 1) && slot.sequence.load(std::memory_order_relaxed) == before;
+    }
+
+    // Keys are uniform hashes, so the set is picked by multiplying into [0, setCount) without a division
+    Set& setOf(uint64_t key) {
+        return sets[uint64_t((unsigned __int128)key * setCount >> 64)];
+    }
+
+    std::string filePath;
+    void* data;
+    size_t size;
+    uint64_t setCount;
+    Set* sets;
+};
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <sys/mman.h>
+
+#include "../libs/xxhash/xxhash.h"
+
+// Struct to hold the tunables of the per-client rate limit
+struct RateLimitConfig {
+    std::atomic<double> ratePerSecond{ 0 }; // 0 disables rate limiting
+    std::atomic<double> burst{ 20 };
+    int maxClients = 100000; // Sizes the table at startup
+};
+
+// Per-client token buckets. Each bucket is a single atomic theoretical arrival time (GCRA), so
+// admitting a request is one lock-free compare-and-swap. Buckets live in a fixed-size set associative
+// table of anonymous shared memory keyed by the hash of the client id, so the workers of --workers,
+// forked after it is mapped, all take from the same bucket whichever of them a connection reached.
+// A client new to a full set takes over the way whose bucket is closest to refilled.
+class RateLimiter {
+public:
+    static constexpr uint32_t WAYS = 4;
+
+    // Key 0 marks a free way
+    struct Way {
+        std::atomic<uint64_t> key;
+        std::atomic<int64_t> arrival; // Theoretical arrival time in steady clock nanoseconds
+    };
+
+    struct alignas(64) Set {
+        Way ways[WAYS];
+    };
+
+    // Zero bytes are free ways, so the mapping needs no construction
+    static_assert(std::atomic<uint64_t>::is_always_lock_free && std::atomic<int64_t>::is_always_lock_free);
+    static_assert(sizeof(Set) == 64);
+
+    // Function to map a table tracking about clients clients at once
+    static std::unique_ptr<RateLimiter> open(const RateLimitConfig& config, size_t clients) {
+        uint64_t setCount = std::max<uint64_t>(1, (clients + WAYS - 1) / WAYS);
+        size_t size = setCount * sizeof(Set);
+        void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (data == MAP_FAILED) throw std::runtime_error(std::string("Cannot map rate limiter: ") + std::strerror(errno));
+        return std::unique_ptr<RateLimiter>(new RateLimiter(config, data, size, setCount));
+    }
+
+    ~RateLimiter() { munmap(data, size); }
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+    // Function to take one token from the client's bucket
+    bool tryAcquire(std::string_view client) {
+        double rate = config.ratePerSecond.load(std::memory_order_relaxed);
+        if (rate <= 0) return true;
+
+        int64_t interval = int64_t(1e9 / rate);
+        int64_t tolerance = int64_t(interval * std::max(1.0, config.burst.load(std::memory_order_relaxed)));
+        int64_t now = nowNs();
+
+        uint64_t key = XXH64(client.data(), client.size(), 0);
+        key = key ? key : 1;
+        Set& set = sets[uint64_t((unsigned __int128)key * setCount >> 64)];
+        for (auto& way : set.ways) {
+            if (way.key.load(std::memory_order_relaxed) == key) return take(way.arrival, now, interval, tolerance);
+        }
+
+        // Claim a free way, else the one closest to refilled; a bucket taken over starts full
+        while (true) {
+            Way* victim = &set.ways[0];
+            for (auto& way : set.ways) {
+                if (way.key.load(std::memory_order_relaxed) == 0) {
+                    victim = &way;
+                    break;
+                }
+                if (way.arrival.load(std::memory_order_relaxed) < victim->arrival.load(std::memory_order_relaxed)) victim = &way;
+            }
+            uint64_t previous = victim->key.load(std::memory_order_relaxed);
+            if (previous == key) return take(victim->arrival, now, interval, tolerance);
+            if (victim->key.compare_exchange_strong(previous, key, std::memory_order_relaxed)) {
+                victim->arrival.store(0, std::memory_order_relaxed);
+                return take(victim->arrival, now, interval, tolerance);
+            }
+        }
+    }
+
+    // Function to count the clients whose buckets have not refilled yet
+    size_t clients() const {
+        int64_t now = nowNs();
+        size_t count = 0;
+        for (uint64_t i = 0; i < setCount; i++) {
+            for (const auto& way : sets[i].ways) {
+                if (way.key.load(std::memory_order_relaxed) != 0 && way.arrival.load(std::memory_order_relaxed) > now) count++;
+            }
+        }
+        return count;
+    }
+
+    size_t capacity() const { return setCount * WAYS; }
+    size_t bytes() const { return size; }
+
+private:
+    RateLimiter(const RateLimitConfig& config, void* data, size_t size, uint64_t setCount)
+        : config(config), data(data), size(size), setCount(setCount), sets(static_cast<Set*>(data)) {}
+
+    static int64_t nowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static bool take(std::atomic<int64_t>& arrival, int64_t now, int64_t interval, int64_t tolerance) {
+        int64_t expected = arrival.load(std::memory_order_relaxed);
+        while (true) {
+            int64_t next = std::max(expected, now) + interval;
+            if (next - now > tolerance) return false;
+            if (arrival.compare_exchange_weak(expected, next, std::memory_order_relaxed)) return true;
+        }
+    }
+
+    const RateLimitConfig& config;
+    void* data;
+    size_t size;
+    uint64_t setCount;
+    Set* sets;
+};
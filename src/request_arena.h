@@ -0,0 +1,108 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+// Memory resource that counts the allocations passed through to its upstream
+class CountingResource : public std::pmr::memory_resource {
+public:
+    explicit CountingResource(std::pmr::memory_resource* upstream) : upstream(upstream) {}
+
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+private:
+    void* do_allocate(size_t size, size_t alignment) override {
+        ++allocations;
+        bytes += size;
+        return upstream->allocate(size, alignment);
+    }
+
+    void do_deallocate(void* pointer, size_t size, size_t alignment) override {
+        upstream->deallocate(pointer, size, alignment);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+    std::pmr::memory_resource* upstream;
+};
+
+// Process-wide counters of request arena usage
+struct ArenaStats {
+    std::atomic<uint64_t> threads{ 0 };
+    std::atomic<uint64_t> requests{ 0 };
+    std::atomic<uint64_t> allocations{ 0 };
+    std::atomic<uint64_t> bytes{ 0 };
+    std::atomic<uint64_t> upstreamAllocations{ 0 };
+    std::atomic<uint64_t> upstreamBytes{ 0 };
+};
+
+inline ArenaStats ARENA_STATS;
+
+// Per-thread monotonic arena, reset whenever the outermost ArenaScope ends
+struct RequestArena {
+    static constexpr size_t initialSize = 64 * 1024;
+
+    RequestArena() { ARENA_STATS.threads++; }
+
+    std::unique_ptr<std::byte[]> buffer = std::make_unique<std::byte[]>(initialSize);
+    CountingResource upstream{ std::pmr::new_delete_resource() };
+    std::pmr::monotonic_buffer_resource monotonic{ buffer.get(), initialSize, &upstream };
+    CountingResource resource{ &monotonic };
+    int depth = 0;
+};
+
+inline thread_local RequestArena REQUEST_ARENA;
+
+// Function to get the memory resource for request-scoped allocations on this thread
+inline std::pmr::memory_resource* currentArena() {
+    return REQUEST_ARENA.depth > 0 ? static_cast<std::pmr::memory_resource*>(&REQUEST_ARENA.resource)
+                                   : std::pmr::new_delete_resource();
+}
+
+// RAII guard marking the lifetime of a request; everything allocated through
+// ArenaAllocator inside it must be destroyed before it ends
+class ArenaScope {
+public:
+    ArenaScope() { REQUEST_ARENA.depth++; }
+
+    ~ArenaScope() {
+        if (--REQUEST_ARENA.depth > 0) return;
+
+        ARENA_STATS.requests++;
+        ARENA_STATS.allocations += REQUEST_ARENA.resource.allocations;
+        ARENA_STATS.bytes += REQUEST_ARENA.resource.bytes;
+        ARENA_STATS.upstreamAllocations += REQUEST_ARENA.upstream.allocations;
+        ARENA_STATS.upstreamBytes += REQUEST_ARENA.upstream.bytes;
+        REQUEST_ARENA.resource.allocations = REQUEST_ARENA.resource.bytes = 0;
+        REQUEST_ARENA.upstream.allocations = REQUEST_ARENA.upstream.bytes = 0;
+        REQUEST_ARENA.monotonic.release();
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+};
+
+// Polymorphic allocator bound to the current thread's request arena; default
+// constructible so it can be plugged into nlohmann::basic_json
+template <typename T>
+struct ArenaAllocator : std::pmr::polymorphic_allocator<T> {
+    ArenaAllocator() noexcept : std::pmr::polymorphic_allocator<T>(currentArena()) {}
+
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) noexcept : std::pmr::polymorphic_allocator<T>(other.resource()) {}
+
+    ArenaAllocator select_on_container_copy_construction() const { return ArenaAllocator(); }
+};
+
+using ArenaString = std::basic_string<char, std::char_traits<char>, ArenaAllocator<char>>;
+
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
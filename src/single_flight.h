@@ -0,0 +1,95 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <unordered_map>
+
+// Coalescing of identical concurrent computations: the first caller for a key leads and computes,
+// callers arriving while it runs follow and receive the leader's result instead of computing again
+template <typename Result>
+class SingleFlight {
+    struct Flight {
+        std::string_view text; // Owned by the leader, which outlives the flight's map entry
+        std::mutex mutex;
+        std::condition_variable finished;
+        bool done = false;
+        std::optional<Result> result;
+    };
+
+public:
+    // Handle to a caller's role in a flight
+    class Ticket {
+    public:
+        Ticket() = default;
+        Ticket(SingleFlight* owner, uint64_t key, std::shared_ptr<Flight> flight, bool leader)
+            : owner(owner), key(key), flight(std::move(flight)), leader(leader) {}
+        Ticket(Ticket&& other) noexcept
+            : owner(other.owner), key(other.key), flight(std::move(other.flight)), leader(other.leader) {}
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+        Ticket& operator=(Ticket&&) = delete;
+
+        // A leader that never published releases its followers empty-handed
+        ~Ticket() {
+            if (leader && flight) owner->finish(key, flight, std::nullopt);
+        }
+
+        bool isFollower() const { return flight && !leader; }
+
+        // Function for followers to wait for the leader; empty when the leader produced nothing
+        std::optional<Result> wait() {
+            std::unique_lock<std::mutex> lock(flight->mutex);
+            flight->finished.wait(lock, [this] { return flight->done; });
+            return flight->result;
+        }
+
+        // Function for the leader to hand its result to the followers
+        void publish(const Result& result) {
+            if (!leader || !flight) return;
+            owner->finish(key, flight, result);
+            flight.reset();
+        }
+
+    private:
+        SingleFlight* owner = nullptr;
+        uint64_t key = 0;
+        std::shared_ptr<Flight> flight;
+        bool leader = false;
+    };
+
+    // Function to join the flight for a key, leading it when none is running. Texts that merely
+    // share the hash are not coalesced.
+    Ticket join(uint64_t key, std::string_view text) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto [entry, inserted] = flights.try_emplace(key);
+        if (inserted) {
+            entry->second = std::make_shared<Flight>();
+            entry->second->text = text;
+            return Ticket(this, key, entry->second, true);
+        }
+        if (entry->second->text != text) return Ticket();
+        return Ticket(this, key, entry->second, false);
+    }
+
+private:
+    void finish(uint64_t key, const std::shared_ptr<Flight>& flight, std::optional<Result> result) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto entry = flights.find(key);
+            if (entry != flights.end() && entry->second == flight) flights.erase(entry);
+        }
+        {
+            std::lock_guard<std::mutex> lock(flight->mutex);
+            flight->result = std::move(result);
+            flight->done = true;
+        }
+        flight->finished.notify_all();
+    }
+
+    std::mutex mutex;
+    std::unordered_map<uint64_t, std::shared_ptr<Flight>> flights;
+};
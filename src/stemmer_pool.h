@@ -0,0 +1,93 @@
+#pragma once
+
+#include <libstemmer.h>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Pool of libstemmer instances, since a single sb_stemmer must not be used by two threads at once
+class StemmerPool {
+public:
+    // RAII handle to a stemmer checked out of the pool
+    class Lease {
+    public:
+        Lease(StemmerPool& pool, sb_stemmer* stemmer) : pool(&pool), stemmer(stemmer) {}
+        Lease(Lease&& other) noexcept : pool(other.pool), stemmer(other.stemmer) { other.stemmer = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        Lease& operator=(Lease&&) = delete;
+        ~Lease() { if (stemmer) pool->release(stemmer); }
+
+        sb_stemmer* get() const { return stemmer; }
+
+    private:
+        StemmerPool* pool;
+        sb_stemmer* stemmer;
+    };
+
+    StemmerPool(const std::string& language, size_t size) : language(language) {
+        idle.reserve(size);
+        try {
+            for (size_t i = 0; i < size; i++) {
+                idle.push_back(create());
+            }
+        }
+        catch (...) {
+            // The destructor does not run for a constructor that throws
+            for (auto stemmer : idle) sb_stemmer_delete(stemmer);
+            throw;
+        }
+        created = size;
+    }
+
+    ~StemmerPool() {
+        for (auto stemmer : idle) sb_stemmer_delete(stemmer);
+    }
+
+    StemmerPool(const StemmerPool&) = delete;
+    StemmerPool& operator=(const StemmerPool&) = delete;
+
+    // Function to check out a stemmer, growing the pool when all are in use
+    Lease acquire() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!idle.empty()) {
+                sb_stemmer* stemmer = idle.back();
+                idle.pop_back();
+                return Lease(*this, stemmer);
+            }
+        }
+        // Counted once it exists, as create() throws when it cannot make one
+        sb_stemmer* stemmer = create();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            created++;
+        }
+        return Lease(*this, stemmer);
+    }
+
+    const std::string& getLanguage() const { return language; }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return created;
+    }
+
+private:
+    sb_stemmer* create() {
+        sb_stemmer* stemmer = sb_stemmer_new(language.c_str(), nullptr);
+        if (!stemmer) throw std::invalid_argument("Unsupported stemmer language: " + language);
+        return stemmer;
+    }
+
+    void release(sb_stemmer* stemmer) {
+        std::lock_guard<std::mutex> lock(mutex);
+        idle.push_back(stemmer);
+    }
+
+    std::string language;
+    std::mutex mutex;
+    std::vector<sb_stemmer*> idle;
+    size_t created = 0;
+};
@@ -0,0 +1,200 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define BLOCKTHETWEET_X86 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BLOCKTHETWEET_NEON 1
+#endif
+
+#if defined(__GNUC__)
+#define BLOCKTHETWEET_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BLOCKTHETWEET_TARGET(isa)
+#endif
+
+// Kernels that lowercase ASCII letters of n bytes into out and set one bit per whitespace byte in
+// spaces, which holds (n + 63) / 64 words; they return whether every byte was ASCII. Whitespace and
+// case follow the "C" locale, exactly like istream extraction and tolower did: only A-Z change, and
+// only the six ASCII space characters split. Non-ASCII letters are left to casefold.h.
+namespace text_simd {
+
+using Kernel = bool (*)(const char* in, char* out, size_t n, uint64_t* spaces);
+
+inline bool isSpace(unsigned char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline char toLower(unsigned char c) {
+    return char(c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c);
+}
+
+// Function to handle up to 64 bytes one at a time; the fallback for non-ASCII blocks and tails
+inline uint64_t lowerScalarBlock(const char* in, char* out, size_t n, bool& ascii) {
+    uint64_t spaces = 0;
+    unsigned char high = 0;
+    for (size_t i = 0; i < n; i++) {
+        unsigned char c = static_cast<unsigned char>(in[i]);
+        out[i] = toLower(c);
+        spaces |= uint64_t(isSpace(c)) << i;
+        high |= c;
+    }
+    ascii &= high < 0x80;
+    return spaces;
+}
+
+inline bool lowerScalar(const char* in, char* out, size_t n, uint64_t* spaces) {
+    bool ascii = true;
+    for (size_t block = 0; block * 64 < n; block++) {
+        size_t size = n - block * 64 < 64 ? n - block * 64 : 64;
+        spaces[block] = lowerScalarBlock(in + block * 64, out + block * 64, size, ascii);
+    }
+    return ascii;
+}
+
+#if defined(BLOCKTHETWEET_X86)
+inline uint32_t lowerSse2Vector(const char* in, char* out, bool& ascii) {
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in));
+    ascii &= _mm_movemask_epi8(bytes) == 0;
+
+    // Signed compares keep bytes >= 0x80 out of both ranges
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('Z' + 1)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm_or_si128(bytes, _mm_and_si128(upper, _mm_set1_epi8(0x20))));
+
+    __m128i space = _mm_or_si128(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(' ')),
+        _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('\t' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('\r' + 1))));
+    return uint32_t(_mm_movemask_epi8(space));
+}
+
+inline bool lowerSse2(const char* in, char* out, size_t n, uint64_t* spaces) {
+    bool textAscii = true;
+    size_t block = 0;
+    for (; (block + 1) * 64 <= n; block++) {
+        const char* source = in + block * 64;
+        char* target = out + block * 64;
+        bool ascii = true;
+        uint64_t mask = uint64_t(lowerSse2Vector(source, target, ascii))
+            | uint64_t(lowerSse2Vector(source + 16, target + 16, ascii)) << 16
+            | uint64_t(lowerSse2Vector(source + 32, target + 32, ascii)) << 32
+            | uint64_t(lowerSse2Vector(source + 48, target + 48, ascii)) << 48;
+        spaces[block] = ascii ? mask : lowerScalarBlock(source, target, 64, textAscii);
+    }
+    if (block * 64 < n) spaces[block] = lowerScalarBlock(in + block * 64, out + block * 64, n - block * 64, textAscii);
+    return textAscii;
+}
+
+BLOCKTHETWEET_TARGET("avx2")
+inline uint64_t lowerAvx2Vector(const char* in, char* out, bool& ascii) {
+    __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in));
+    ascii &= _mm256_movemask_epi8(bytes) == 0;
+
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), bytes));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_or_si256(bytes, _mm256_and_si256(upper, _mm256_set1_epi8(0x20))));
+
+    __m256i space = _mm256_or_si256(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' ')),
+        _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('\t' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), bytes)));
+    return uint32_t(_mm256_movemask_epi8(space));
+}
+
+BLOCKTHETWEET_TARGET("avx2")
+inline bool lowerAvx2(const char* in, char* out, size_t n, uint64_t* spaces) {
+    bool textAscii = true;
+    size_t block = 0;
+    for (; (block + 1) * 64 <= n; block++) {
+        const char* source = in + block * 64;
+        char* target = out + block * 64;
+        bool ascii = true;
+        uint64_t mask = lowerAvx2Vector(source, target, ascii) | lowerAvx2Vector(source + 32, target + 32, ascii) << 32;
+        spaces[block] = ascii ? mask : lowerScalarBlock(source, target, 64, textAscii);
+    }
+    if (block * 64 < n) spaces[block] = lowerScalarBlock(in + block * 64, out + block * 64, n - block * 64, textAscii);
+    return textAscii;
+}
+#endif
+
+#if defined(BLOCKTHETWEET_NEON)
+inline uint64_t lowerNeonVector(const char* in, char* out, bool& ascii) {
+    uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t*>(in));
+    ascii &= vmaxvq_u8(bytes) < 0x80;
+
+    // Unsigned range checks by subtraction: c - 'A' < 26 and c - '\t' < 5
+    uint8x16_t upper = vcltq_u8(vsubq_u8(bytes, vdupq_n_u8('A')), vdupq_n_u8(26));
+    vst1q_u8(reinterpret_cast<uint8_t*>(out), vorrq_u8(bytes, vandq_u8(upper, vdupq_n_u8(0x20))));
+
+    uint8x16_t space = vorrq_u8(vceqq_u8(bytes, vdupq_n_u8(' ')), vcltq_u8(vsubq_u8(bytes, vdupq_n_u8('\t')), vdupq_n_u8(5)));
+
+    // Movemask emulation: weight each lane by its bit and add up each half
+    static const uint8_t weights[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+    uint8x16_t bits = vandq_u8(space, vld1q_u8(weights));
+    return uint64_t(vaddv_u8(vget_low_u8(bits))) | uint64_t(vaddv_u8(vget_high_u8(bits))) << 8;
+}
+
+inline bool lowerNeon(const char* in, char* out, size_t n, uint64_t* spaces) {
+    bool textAscii = true;
+    size_t block = 0;
+    for (; (block + 1) * 64 <= n; block++) {
+        const char* source = in + block * 64;
+        char* target = out + block * 64;
+        bool ascii = true;
+        uint64_t mask = lowerNeonVector(source, target, ascii)
+            | lowerNeonVector(source + 16, target + 16, ascii) << 16
+            | lowerNeonVector(source + 32, target + 32, ascii) << 32
+            | lowerNeonVector(source + 48, target + 48, ascii) << 48;
+        spaces[block] = ascii ? mask : lowerScalarBlock(source, target, 64, textAscii);
+    }
+    if (block * 64 < n) spaces[block] = lowerScalarBlock(in + block * 64, out + block * 64, n - block * 64, textAscii);
+    return textAscii;
+}
+#endif
+
+// Function to pick the widest kernel the CPU supports
+inline Kernel selectKernel() {
+#if defined(BLOCKTHETWEET_X86) && defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) return lowerAvx2;
+    return lowerSse2;
+#elif defined(BLOCKTHETWEET_X86)
+    return lowerSse2;
+#elif defined(BLOCKTHETWEET_NEON)
+    return lowerNeon;
+#else
+    return lowerScalar;
+#endif
+}
+
+inline const Kernel LOWER_AND_MARK_SPACES = selectKernel();
+
+// Function to call f(begin, end) for each whitespace-separated word of the n bytes described by the
+// bitmap, in order, until f returns false
+template <typename Function>
+void forEachWord(const uint64_t* spaces, size_t n, Function&& f) {
+    bool inWord = false;
+    size_t begin = 0;
+    uint64_t previous = 0; // Whether the last byte of the previous block was part of a word
+
+    for (size_t block = 0; block * 64 < n; block++) {
+        uint64_t words = ~spaces[block];
+        if (n - block * 64 < 64) words &= (uint64_t(1) << (n - block * 64)) - 1;
+
+        // Each set bit is a byte where a word starts or ends
+        uint64_t transitions = words ^ ((words << 1) | previous);
+        previous = words >> 63;
+        while (transitions) {
+            size_t position = block * 64 + size_t(__builtin_ctzll(transitions));
+            transitions &= transitions - 1;
+            if (!inWord) {
+                begin = position;
+            }
+            else if (!f(begin, position)) {
+                return;
+            }
+            inWord = !inWord;
+        }
+    }
+    if (inWord) f(begin, n);
+}
+
+}
@@ -0,0 +1,293 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "../libs/nlohmann/json.hpp"
+#include "../libs/xxhash/xxhash.h"
+#include "perfect_hash.h"
+
+// Interface of a word index mapping stemmed words to token ids, unknown words to 0
+class Vocabulary {
+public:
+    virtual ~Vocabulary() = default;
+
+    virtual int64_t lookup(std::string_view word) const = 0;
+
+    // Function to find the token ids of count words into ids, the same as calling lookup on each
+    virtual void lookupBatch(const std::string_view* words, size_t count, int64_t* ids) const = 0;
+
+    // Function to call f(word, id) for every entry
+    virtual void forEach(const std::function<void(std::string_view, int64_t)>& f) const = 0;
+
+    virtual size_t size() const = 0;
+    virtual size_t bytes() const = 0;
+};
+
+// Word index packed for cache residency. Keys are sorted and front coded in blocks of BLOCK words:
+// the first word of a block is stored whole, the others as the length of the prefix they share with
+// their predecessor plus the remaining bytes. Ids are int32 in key order. An open-addressing table
+// of fingerprints and key indexes finds a word's position, so a probe only decodes a block when
+// the fingerprint already matched.
+class PackedVocabulary final : public Vocabulary {
+public:
+    // Function to build the table from a word index object of word to token id
+    explicit PackedVocabulary(const nlohmann::json& wordIndex) {
+        if (!wordIndex.is_object()) throw std::invalid_argument("Word index must be a JSON object");
+        if (wordIndex.size() >= EMPTY) throw std::length_error("Word index has too many words");
+
+        std::vector<std::pair<std::string_view, int32_t>> words;
+        words.reserve(wordIndex.size());
+        for (const auto& [word, id] : wordIndex.get_ref<const nlohmann::json::object_t&>()) {
+            int64_t value = id.get<int64_t>();
+            if (value < INT32_MIN || value > INT32_MAX) throw std::out_of_range("Token id out of int32 range: " + word);
+            words.emplace_back(word, int32_t(value));
+        }
+        std::sort(words.begin(), words.end());
+
+        std::string_view previous;
+        ids.reserve(words.size());
+        blockOffsets.reserve((words.size() + BLOCK - 1) / BLOCK);
+        for (size_t index = 0; index < words.size(); index++) {
+            std::string_view word = words[index].first;
+            if (index % BLOCK == 0) {
+                blockOffsets.push_back(uint32_t(keys.size()));
+                appendVarint(word.size());
+            }
+            else {
+                size_t shared = commonPrefix(previous, word);
+                appendVarint(shared);
+                appendVarint(word.size() - shared);
+                word.remove_prefix(shared);
+            }
+            keys.append(word);
+            if (keys.size() > UINT32_MAX) throw std::length_error("Word index keys exceed 4 GiB");
+            ids.push_back(words[index].second);
+            previous = words[index].first;
+        }
+
+        // At least one slot stays empty, or a probe for a missing word would never stop
+        size_t capacity = 1;
+        while (capacity <= words.size() + words.size() / 4) capacity <<= 1;
+        slots.resize(capacity);
+        mask = capacity - 1;
+        for (size_t index = 0; index < words.size(); index++) {
+            uint64_t hash = hashOf(words[index].first);
+            size_t position = hash & mask;
+            while (slots[position].index != EMPTY) position = (position + 1) & mask;
+            slots[position] = Slot{ fingerprintOf(hash), uint32_t(index) };
+        }
+    }
+
+    // Function to find the token id of a word, 0 for unknown words
+    int64_t lookup(std::string_view word) const override {
+        return probe(word, hashOf(word));
+    }
+
+    // Function to find the token ids of many words at once. Hashing all of them first lets the slot
+    // and key loads of different words overlap instead of each waiting on its own cache misses.
+    void lookupBatch(const std::string_view* words, size_t count, int64_t* ids) const override {
+        constexpr size_t chunk = 32;
+        uint64_t hashes[chunk];
+        for (size_t base = 0; base < count; base += chunk) {
+            size_t size = std::min(chunk, count - base);
+            for (size_t i = 0; i < size; i++) {
+                hashes[i] = hashOf(words[base + i]);
+                prefetch(&slots[hashes[i] & mask]);
+            }
+            for (size_t i = 0; i < size; i++) {
+                const Slot& slot = slots[hashes[i] & mask];
+                if (slot.index != EMPTY && slot.fingerprint == fingerprintOf(hashes[i])) {
+                    prefetch(keys.data() + blockOffsets[slot.index / BLOCK]);
+                    prefetch(&this->ids[slot.index]);
+                }
+            }
+            for (size_t i = 0; i < size; i++) {
+                ids[base + i] = probe(words[base + i], hashes[i]);
+            }
+        }
+    }
+
+    // Function to call f(word, id) for every entry, in key order
+    void forEach(const std::function<void(std::string_view, int64_t)>& f) const override {
+        std::string word;
+        const char* cursor = keys.data();
+        for (size_t index = 0; index < ids.size(); index++) {
+            size_t shared = index % BLOCK == 0 ? 0 : readVarint(cursor);
+            size_t length = readVarint(cursor);
+            word.resize(shared);
+            word.append(cursor, length);
+            cursor += length;
+            f(std::string_view(word), int64_t(ids[index]));
+        }
+    }
+
+    size_t size() const override { return ids.size(); }
+
+    size_t bytes() const override {
+        return sizeof(*this) + slots.capacity() * sizeof(Slot) + blockOffsets.capacity() * sizeof(uint32_t)
+            + keys.capacity() + ids.capacity() * sizeof(int32_t);
+    }
+
+private:
+    static constexpr uint32_t EMPTY = UINT32_MAX;
+    static constexpr size_t BLOCK = 16;
+
+    struct Slot {
+        uint32_t fingerprint = 0; // High half of the word's hash; the low half picked the slot
+        uint32_t index = EMPTY; // Position of the word in key order
+    };
+
+    static uint64_t hashOf(std::string_view word) {
+        return XXH64(word.data(), word.size(), 0);
+    }
+
+    static uint32_t fingerprintOf(uint64_t hash) {
+        return uint32_t(hash >> 32);
+    }
+
+    static void prefetch(const void* address) {
+#if defined(__GNUC__)
+        __builtin_prefetch(address);
+#endif
+    }
+
+    static size_t commonPrefix(std::string_view a, std::string_view b) {
+        size_t length = std::min(a.size(), b.size());
+        size_t i = 0;
+        while (i < length && a[i] == b[i]) i++;
+        return i;
+    }
+
+    void appendVarint(size_t value) {
+        while (value >= 0x80) {
+            keys.push_back(char(value | 0x80));
+            value >>= 7;
+        }
+        keys.push_back(char(value));
+    }
+
+    static size_t readVarint(const char*& cursor) {
+        size_t value = 0;
+        for (int shift = 0;; shift += 7) {
+            auto byte = static_cast<unsigned char>(*cursor++);
+            value |= size_t(byte & 0x7F) << shift;
+            if (byte < 0x80) return value;
+        }
+    }
+
+    // Function to tell whether the key at index equals word. Walking its block keeps only the
+    // length of the prefix word shares with the current key: a key sharing fewer bytes with its
+    // predecessor than that cuts the match there, one sharing more keeps it, and only one sharing
+    // exactly that many needs its remaining bytes compared.
+    bool keyEquals(uint32_t index, std::string_view word) const {
+        const char* cursor = keys.data() + blockOffsets[index / BLOCK];
+        size_t length = readVarint(cursor);
+        size_t matched = commonPrefix(word, std::string_view(cursor, length));
+        cursor += length;
+
+        for (size_t step = index % BLOCK; step > 0; step--) {
+            size_t shared = readVarint(cursor);
+            size_t rest = readVarint(cursor);
+            if (shared < matched) {
+                matched = shared;
+            }
+            else if (shared == matched) {
+                matched += commonPrefix(word.substr(matched), std::string_view(cursor, rest));
+            }
+            length = shared + rest;
+            cursor += rest;
+        }
+        return matched == word.size() && length == word.size();
+    }
+
+    int64_t probe(std::string_view word, uint64_t hash) const {
+        uint32_t fingerprint = fingerprintOf(hash);
+        for (size_t position = hash & mask;; position = (position + 1) & mask) {
+            const Slot& slot = slots[position];
+            if (slot.index == EMPTY) return 0;
+            if (slot.fingerprint == fingerprint && keyEquals(slot.index, word)) return ids[slot.index];
+        }
+    }
+
+    std::vector<Slot> slots;
+    std::vector<uint32_t> blockOffsets; // Start of each block of BLOCK keys in keys
+    std::string keys;
+    std::vector<int32_t> ids;
+    size_t mask = 0;
+};
+
+// Word index laid out as a minimal perfect hash table (perfect_hash.h) in memory it does not own:
+// the arrays compiled into the binary or a section of a mapped bundle. Keys sit in slot order, so a
+// lookup is one hash, one pilot and one compare.
+class PerfectHashVocabulary final : public Vocabulary {
+public:
+    PerfectHashVocabulary(const uint32_t* pilots, uint32_t bucketCount, const uint32_t* offsets, const int32_t* ids,
+        const char* keys, uint32_t wordCount)
+        : pilots(pilots), bucketCount(bucketCount), offsets(offsets), ids(ids), keys(keys), wordCount(wordCount) {}
+
+    int64_t lookup(std::string_view word) const override {
+        if (wordCount == 0) return 0;
+        return find(word, slotOf(perfect_hash::hashOf(word)));
+    }
+
+    // Function to find the token ids of many words at once, prefetching each slot's key first
+    void lookupBatch(const std::string_view* words, size_t count, int64_t* ids) const override {
+        if (wordCount == 0) {
+            std::fill(ids, ids + count, 0);
+            return;
+        }
+        constexpr size_t chunk = 32;
+        uint32_t slots[chunk];
+        for (size_t base = 0; base < count; base += chunk) {
+            size_t size = std::min(chunk, count - base);
+            for (size_t i = 0; i < size; i++) {
+                slots[i] = slotOf(perfect_hash::hashOf(words[base + i]));
+#if defined(__GNUC__)
+                __builtin_prefetch(keys + offsets[slots[i]]);
+#endif
+            }
+            for (size_t i = 0; i < size; i++) {
+                ids[base + i] = find(words[base + i], slots[i]);
+            }
+        }
+    }
+
+    void forEach(const std::function<void(std::string_view, int64_t)>& f) const override {
+        for (uint32_t slot = 0; slot < wordCount; slot++) f(key(slot), ids[slot]);
+    }
+
+    size_t size() const override { return wordCount; }
+
+    // Bytes of the tables, which live in read-only pages paged in as they are touched
+    size_t bytes() const override {
+        return sizeof(*this) + size_t(bucketCount) * sizeof(uint32_t) + (size_t(wordCount) + 1) * sizeof(uint32_t)
+            + size_t(wordCount) * sizeof(int32_t) + offsets[wordCount];
+    }
+
+private:
+    uint32_t slotOf(uint64_t hash) const {
+        return perfect_hash::slotOf(hash, pilots[perfect_hash::bucketOf(hash, bucketCount)], wordCount);
+    }
+
+    std::string_view key(uint32_t slot) const {
+        return std::string_view(keys + offsets[slot], offsets[slot + 1] - offsets[slot]);
+    }
+
+    int64_t find(std::string_view word, uint32_t slot) const {
+        return key(slot) == word ? ids[slot] : 0;
+    }
+
+    const uint32_t* pilots;
+    uint32_t bucketCount;
+    const uint32_t* offsets; // wordCount + 1 entries
+    const int32_t* ids;
+    const char* keys;
+    uint32_t wordCount;
+};
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Model parameters and buffers stored raw, so processes on a host can map one file and share its
+// physical pages instead of each holding a private copy. Tensors are contiguous and found by name;
+// the file is tied to the TorchScript archive it was exported from by that archive's hash.
+namespace weight_file {
+
+inline constexpr char MAGIC[8] = { 'B', 'T', 'T', 'W', 'G', 'H', 'T', '\0' };
+inline constexpr uint32_t VERSION = 1;
+inline constexpr size_t ALIGNMENT = 64; // Tensor data starts on cache line boundaries
+inline constexpr size_t MAX_DIMS = 8;
+
+// File layout: header, tensor entries, names, tensor data
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t tensorCount;
+    uint64_t modelHash; // XXH64 of the TorchScript archive the tensors were exported from
+    uint64_t namesOffset;
+    uint64_t namesSize;
+};
+
+struct TensorEntry {
+    uint32_t nameOffset; // Into the names
+    uint32_t nameLength;
+    int32_t dtype; // c10::ScalarType
+    uint32_t dims;
+    int64_t sizes[MAX_DIMS];
+    uint64_t offset; // Of the data, from the start of the file
+    uint64_t bytes;
+};
+
+// Struct to describe a tensor to write, whose data is contiguous
+struct Tensor {
+    std::string name;
+    int32_t dtype;
+    std::vector<int64_t> sizes;
+    const void* data;
+    size_t bytes;
+};
+
+inline size_t aligned(size_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+// Function to write a weight file; returns its size in bytes
+inline size_t write(const std::string& path, uint64_t modelHash, const std::vector<Tensor>& tensors) {
+    std::vector<TensorEntry> entries(tensors.size());
+    std::string names;
+    for (size_t i = 0; i < tensors.size(); i++) {
+        if (tensors[i].sizes.size() > MAX_DIMS) throw std::invalid_argument("Tensor has too many dimensions: " + tensors[i].name);
+        entries[i].nameOffset = uint32_t(names.size());
+        entries[i].nameLength = uint32_t(tensors[i].name.size());
+        entries[i].dtype = tensors[i].dtype;
+        entries[i].dims = uint32_t(tensors[i].sizes.size());
+        std::copy(tensors[i].sizes.begin(), tensors[i].sizes.end(), entries[i].sizes);
+        entries[i].bytes = tensors[i].bytes;
+        names.append(tensors[i].name);
+    }
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.tensorCount = uint32_t(tensors.size());
+    header.modelHash = modelHash;
+    header.namesOffset = sizeof(Header) + entries.size() * sizeof(TensorEntry);
+    header.namesSize = names.size();
+    size_t offset = header.namesOffset + names.size();
+    for (auto& entry : entries) {
+        entry.offset = aligned(offset);
+        offset = entry.offset + entry.bytes;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) throw std::runtime_error("Cannot write weight file: " + path);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(TensorEntry));
+    out.write(names.data(), names.size());
+    size_t written = header.namesOffset + names.size();
+    for (size_t i = 0; i < tensors.size(); i++) {
+        std::string padding(entries[i].offset - written, '\0');
+        out.write(padding.data(), padding.size());
+        out.write(static_cast<const char*>(tensors[i].data), tensors[i].bytes);
+        written = entries[i].offset + entries[i].bytes;
+    }
+    if (!out) throw std::runtime_error("Cannot write weight file: " + path);
+    return written;
+}
+
+// Read-only shared mapping of a weight file
+class WeightFile {
+public:
+    // Function to map a weight file; populate faults every page in up front so inference never does
+    static std::unique_ptr<WeightFile> open(const std::string& path, bool populate) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open weight file: " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Weight file is truncated: " + path);
+        }
+        // Shared, so every process mapping the file uses the same page cache pages
+        int flags = MAP_SHARED;
+#if defined(MAP_POPULATE)
+        if (populate) flags |= MAP_POPULATE;
+#endif
+        void* data = mmap(nullptr, info.st_size, PROT_READ, flags, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("Cannot map weight file: " + path);
+        if (populate) madvise(data, info.st_size, MADV_WILLNEED);
+        return std::unique_ptr<WeightFile>(new WeightFile(path, data, info.st_size));
+    }
+
+    ~WeightFile() {
+        if (locked) munlock(data, size);
+        munmap(data, size);
+    }
+
+    WeightFile(const WeightFile&) = delete;
+    WeightFile& operator=(const WeightFile&) = delete;
+
+    const Header& header() const { return *static_cast<const Header*>(data); }
+    size_t bytes() const { return size; }
+    bool isLocked() const { return locked; }
+
+    const TensorEntry* find(std::string_view name) const {
+        auto entry = byName.find(name);
+        return entry == byName.end() ? nullptr : entry->second;
+    }
+
+    // Tensor data; PROT_READ, so a stray write faults instead of silently unsharing a page
+    const void* tensorData(const TensorEntry& entry) const {
+        return static_cast<const char*>(data) + entry.offset;
+    }
+
+    // Function to pin the mapping in memory, so the latency path never waits on a page fault
+    void lock() {
+        if (mlock(data, size) != 0) {
+            throw std::runtime_error(std::string("Cannot lock weight file in memory (check RLIMIT_MEMLOCK): ") + std::strerror(errno));
+        }
+        locked = true;
+    }
+
+private:
+    WeightFile(const std::string& path, void* data, size_t size) : data(data), size(size) {
+        const Header& header = this->header();
+        const char* bytes = static_cast<const char*>(data);
+        bool valid = std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0 && header.version == VERSION
+            && header.namesOffset == sizeof(Header) + size_t(header.tensorCount) * sizeof(TensorEntry)
+            && header.namesOffset <= size && header.namesSize <= size - header.namesOffset;
+        for (uint32_t i = 0; valid && i < header.tensorCount; i++) {
+            const TensorEntry& entry = reinterpret_cast<const TensorEntry*>(bytes + sizeof(Header))[i];
+            valid = entry.dims <= MAX_DIMS && entry.offset % ALIGNMENT == 0 && entry.offset <= size && entry.bytes <= size - entry.offset
+                && size_t(entry.nameOffset) + entry.nameLength <= header.namesSize;
+            if (valid) byName.emplace(std::string_view(bytes + header.namesOffset + entry.nameOffset, entry.nameLength), &entry);
+        }
+        if (!valid) {
+            munmap(data, size);
+            throw std::runtime_error("Not a valid weight file of version " + std::to_string(VERSION) + ": " + path);
+        }
+    }
+
+    void* data;
+    size_t size;
+    bool locked = false;
+    std::unordered_map<std::string_view, const TensorEntry*> byName;
+};
+
+}
@@ -0,0 +1,331 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Minimal acyclic automaton mapping lowercased surface words straight to token ids, compiled from
+// the vocabulary and the inflections that stem to its entries. Outputs are ranked: every transition
+// records how many words sort before the ones reached through it, so the walk that accepts a word
+// also computes its index into the id array. The file is mapped and used in place.
+namespace word_fst {
+
+inline constexpr char MAGIC[8] = { 'B', 'T', 'T', 'F', 'S', 'T', '\0', '\0' };
+inline constexpr uint32_t VERSION = 1;
+
+// File layout: header, states (plus a sentinel), labels padded to 4 bytes, transitions, ids
+struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t stateCount;
+    uint32_t transitionCount;
+    uint32_t wordCount;
+    uint64_t vocabularyHash; // Of the word index the ids come from
+    char language[16]; // Stemmer language the inflections were resolved with
+};
+
+struct State {
+    uint32_t firstTransition; // Transitions of state s are [states[s].firstTransition, states[s + 1].firstTransition)
+    uint32_t final;
+};
+
+struct Transition {
+    uint32_t target;
+    uint32_t skip; // Words accepted from the source state that sort before this transition's words
+};
+
+inline size_t paddedLabelBytes(uint32_t transitionCount) {
+    return (size_t(transitionCount) + 3) & ~size_t(3);
+}
+
+// Read-only view of a compiled automaton mapped from disk
+class WordFst {
+public:
+    static std::unique_ptr<WordFst> open(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("Cannot open word FST: " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0 || size_t(info.st_size) < sizeof(Header)) {
+            ::close(fd);
+            throw std::runtime_error("Word FST is truncated: " + path);
+        }
+        void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (data == MAP_FAILED) throw std::runtime_error("Cannot map word FST: " + path);
+        return std::unique_ptr<WordFst>(new WordFst(path, data, info.st_size));
+    }
+
+    ~WordFst() { munmap(data, size); }
+
+    WordFst(const WordFst&) = delete;
+    WordFst& operator=(const WordFst&) = delete;
+
+    // Function to find a word's token id in one left-to-right walk; false when the word was not compiled in
+    bool lookup(std::string_view word, int64_t& id) const {
+        uint32_t state = 0;
+        uint32_t rank = 0;
+        for (char c : word) {
+            uint32_t begin = states[state].firstTransition;
+            uint32_t end = states[state + 1].firstTransition;
+            auto label = static_cast<const uint8_t*>(std::memchr(labels + begin, static_cast<unsigned char>(c), end - begin));
+            if (!label) return false;
+            const Transition& transition = transitions[label - labels];
+            rank += transition.skip;
+            state = transition.target;
+        }
+        if (!states[state].final) return false;
+        id = ids[rank];
+        return true;
+    }
+
+    const Header& header() const { return *static_cast<const Header*>(data); }
+    size_t bytes() const { return size; }
+
+private:
+    WordFst(const std::string& path, void* data, size_t size) : data(data), size(size) {
+        const Header& header = this->header();
+        if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION) {
+            munmap(data, size);
+            throw std::runtime_error("Not a word FST of version " + std::to_string(VERSION) + ": " + path);
+        }
+        size_t expected = sizeof(Header) + (size_t(header.stateCount) + 1) * sizeof(State)
+            + paddedLabelBytes(header.transitionCount) + size_t(header.transitionCount) * sizeof(Transition)
+            + size_t(header.wordCount) * sizeof(int32_t);
+        if (header.stateCount == 0 || size != expected) {
+            munmap(data, size);
+            throw std::runtime_error("Word FST has an unexpected size: " + path);
+        }
+
+        auto bytes = static_cast<const char*>(data) + sizeof(Header);
+        states = reinterpret_cast<const State*>(bytes);
+        bytes += (size_t(header.stateCount) + 1) * sizeof(State);
+        labels = reinterpret_cast<const uint8_t*>(bytes);
+        bytes += paddedLabelBytes(header.transitionCount);
+        transitions = reinterpret_cast<const Transition*>(bytes);
+        bytes += size_t(header.transitionCount) * sizeof(Transition);
+        ids = reinterpret_cast<const int32_t*>(bytes);
+
+        if (!valid()) {
+            munmap(data, size);
+            throw std::runtime_error("Word FST is damaged: " + path);
+        }
+    }
+
+    // Function to check once what lookup trusts: transitions of each state lie in order within the
+    // transition array, targets are states, the automaton is acyclic, and no walk ranks past the ids.
+    // Reaching state s with rank r keeps r + count[s] <= wordCount when the root accepts wordCount
+    // words and no transition skips more than its source leaves room for.
+    bool valid() const {
+        const Header& header = this->header();
+        uint32_t stateCount = header.stateCount;
+        if (states[0].firstTransition != 0 || states[stateCount].firstTransition != header.transitionCount) return false;
+        for (uint32_t state = 0; state < stateCount; state++) {
+            if (states[state].firstTransition > states[state + 1].firstTransition) return false;
+        }
+        for (uint32_t transition = 0; transition < header.transitionCount; transition++) {
+            if (transitions[transition].target >= stateCount) return false;
+        }
+
+        // Words accepted from each state, counted in post order by an explicit stack so no depth of
+        // the automaton can overflow the call stack
+        enum : uint8_t { UNVISITED, OPEN, COUNTED };
+        std::vector<uint8_t> mark(stateCount, UNVISITED);
+        std::vector<uint64_t> count(stateCount, 0);
+        std::vector<std::pair<uint32_t, uint32_t>> stack; // State, next transition
+        for (uint32_t root = 0; root < stateCount; root++) {
+            if (mark[root] != UNVISITED) continue;
+            mark[root] = OPEN;
+            stack.emplace_back(root, states[root].firstTransition);
+            while (!stack.empty()) {
+                auto [state, next] = stack.back();
+                if (next < states[state + 1].firstTransition) {
+                    stack.back().second++;
+                    uint32_t target = transitions[next].target;
+                    if (mark[target] == OPEN) return false;
+                    if (mark[target] == UNVISITED) {
+                        mark[target] = OPEN;
+                        stack.emplace_back(target, states[target].firstTransition);
+                    }
+                    continue;
+                }
+                stack.pop_back();
+                uint64_t words = states[state].final ? 1 : 0;
+                for (uint32_t t = states[state].firstTransition; t < states[state + 1].firstTransition; t++) {
+                    words += count[transitions[t].target];
+                    if (words > header.wordCount) return false;
+                }
+                for (uint32_t t = states[state].firstTransition; t < states[state + 1].firstTransition; t++) {
+                    if (uint64_t(transitions[t].skip) + count[transitions[t].target] > words) return false;
+                }
+                count[state] = words;
+                mark[state] = COUNTED;
+            }
+        }
+        return count[0] == header.wordCount;
+    }
+
+    void* data;
+    size_t size;
+    const State* states = nullptr;
+    const uint8_t* labels = nullptr;
+    const Transition* transitions = nullptr;
+    const int32_t* ids = nullptr;
+};
+
+// Builder of the minimal automaton by incremental construction from sorted words (Daciuk et al.),
+// registering each state once its right language can no longer change
+class WordFstBuilder {
+public:
+    // Function to build from (word, id) pairs in any order and write the file; returns the state count
+    static size_t write(const std::string& path, std::vector<std::pair<std::string, int32_t>> words,
+        uint64_t vocabularyHash, const std::string& language) {
+        words.erase(std::remove_if(words.begin(), words.end(), [](const auto& word) { return word.first.empty(); }), words.end());
+        std::sort(words.begin(), words.end());
+        words.erase(std::unique(words.begin(), words.end(),
+            [](const auto& a, const auto& b) { return a.first == b.first; }), words.end());
+
+        WordFstBuilder builder;
+        std::string_view previous;
+        for (const auto& [word, id] : words) {
+            builder.add(previous, word);
+            previous = word;
+        }
+        if (!builder.nodes[0].edges.empty()) builder.replaceOrRegister(0);
+        return builder.save(path, words, vocabularyHash, language);
+    }
+
+private:
+    struct Node {
+        bool final = false;
+        std::vector<std::pair<uint8_t, uint32_t>> edges; // Sorted by label, as words arrive sorted
+    };
+
+    WordFstBuilder() : nodes(1) {}
+
+    void add(std::string_view previous, std::string_view word) {
+        size_t common = 0;
+        uint32_t node = 0;
+        while (common < previous.size() && common < word.size() && previous[common] == word[common]) {
+            node = nodes[node].edges.back().second;
+            common++;
+        }
+        if (!nodes[node].edges.empty()) replaceOrRegister(node);
+
+        for (size_t i = common; i < word.size(); i++) {
+            uint32_t next = uint32_t(nodes.size());
+            nodes.emplace_back();
+            nodes[node].edges.emplace_back(static_cast<uint8_t>(word[i]), next);
+            node = next;
+        }
+        nodes[node].final = true;
+    }
+
+    // Function to merge the last child of node, and its last descendants, with equivalent registered
+    // states, deepest first. The chain is walked with a loop, as a word may be arbitrarily long.
+    void replaceOrRegister(uint32_t node) {
+        std::vector<uint32_t> parents{ node };
+        for (uint32_t child = nodes[node].edges.back().second; !nodes[child].edges.empty(); child = nodes[child].edges.back().second) {
+            parents.push_back(child);
+        }
+        for (auto parent = parents.rbegin(); parent != parents.rend(); ++parent) {
+            uint32_t child = nodes[*parent].edges.back().second;
+            auto [entry, inserted] = registry.try_emplace(signature(child), child);
+            if (!inserted) nodes[*parent].edges.back().second = entry->second;
+        }
+    }
+
+    std::string signature(uint32_t node) const {
+        std::string key(1, nodes[node].final ? '1' : '0');
+        for (const auto& [label, target] : nodes[node].edges) {
+            key.push_back(char(label));
+            key.append(reinterpret_cast<const char*>(&target), sizeof(target));
+        }
+        return key;
+    }
+
+    size_t save(const std::string& path, const std::vector<std::pair<std::string, int32_t>>& words,
+        uint64_t vocabularyHash, const std::string& language) {
+        // Number states reachable from the root in depth-first order, counting the words below each
+        std::vector<uint32_t> number(nodes.size(), UINT32_MAX);
+        std::vector<uint32_t> order;
+        std::vector<uint32_t> count(nodes.size(), 0);
+        numberStates(0, number, order, count);
+
+        std::vector<State> states;
+        std::vector<uint8_t> labels;
+        std::vector<Transition> transitions;
+        for (uint32_t node : order) {
+            states.push_back({ uint32_t(transitions.size()), nodes[node].final ? 1u : 0u });
+            uint32_t skip = nodes[node].final ? 1 : 0;
+            for (const auto& [label, target] : nodes[node].edges) {
+                labels.push_back(label);
+                transitions.push_back({ number[target], skip });
+                skip += count[target];
+            }
+        }
+        states.push_back({ uint32_t(transitions.size()), 0 });
+        labels.resize(paddedLabelBytes(uint32_t(transitions.size())), 0);
+
+        Header header{};
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.stateCount = uint32_t(order.size());
+        header.transitionCount = uint32_t(transitions.size());
+        header.wordCount = uint32_t(words.size());
+        header.vocabularyHash = vocabularyHash;
+        std::strncpy(header.language, language.c_str(), sizeof(header.language) - 1);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("Cannot write word FST: " + path);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(states.data()), states.size() * sizeof(State));
+        out.write(reinterpret_cast<const char*>(labels.data()), labels.size());
+        out.write(reinterpret_cast<const char*>(transitions.data()), transitions.size() * sizeof(Transition));
+        for (const auto& [word, id] : words) out.write(reinterpret_cast<const char*>(&id), sizeof(id));
+        if (!out) throw std::runtime_error("Cannot write word FST: " + path);
+        return order.size();
+    }
+
+    // Function to number the states reachable from node in depth-first preorder and count the words
+    // below each, with an explicit stack rather than one call per character of the longest word
+    void numberStates(uint32_t node, std::vector<uint32_t>& number, std::vector<uint32_t>& order, std::vector<uint32_t>& count) {
+        std::vector<std::pair<uint32_t, size_t>> stack; // Node, next edge
+        auto enter = [&](uint32_t entered) {
+            number[entered] = uint32_t(order.size());
+            order.push_back(entered);
+            count[entered] = nodes[entered].final ? 1 : 0;
+            stack.emplace_back(entered, 0);
+        };
+        enter(node);
+        while (!stack.empty()) {
+            auto [current, edge] = stack.back();
+            if (edge == nodes[current].edges.size()) {
+                stack.pop_back();
+                if (!stack.empty()) count[stack.back().first] += count[current];
+                continue;
+            }
+            stack.back().second++;
+            uint32_t target = nodes[current].edges[edge].second;
+            if (number[target] == UINT32_MAX) enter(target);
+            else count[current] += count[target];
+        }
+    }
+
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, uint32_t> registry;
+};
+
+}
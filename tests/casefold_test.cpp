@@ -0,0 +1,125 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include "check.h"
+#include "../src/casefold.h"
+#include "../src/text_simd.h"
+
+// Function to fold a word into a string of its own
+std::string fold(std::string_view word) {
+    std::string out;
+    return std::string(casefold::foldUtf8(word, out));
+}
+
+std::string utf8(uint32_t cp) {
+    std::string out;
+    casefold::appendUtf8(out, cp);
+    return out;
+}
+
+// Function to split and fold text the way the tokenizer's forEachWord does: the SIMD kernel lowers
+// ASCII and marks whitespace, and words are only case folded when it saw non-ASCII bytes
+std::vector<std::string> words(std::string_view text) {
+    std::string lowered(text.size(), '\0');
+    std::vector<uint64_t> spaces((text.size() + 63) / 64);
+    bool ascii = text_simd::LOWER_AND_MARK_SPACES(text.data(), lowered.data(), text.size(), spaces.data());
+    std::string folded;
+    std::vector<std::string> result;
+    text_simd::forEachWord(spaces.data(), text.size(), [&](size_t begin, size_t end) {
+        std::string_view word = std::string_view(lowered).substr(begin, end - begin);
+        if (!ascii) word = casefold::foldUtf8(word, folded);
+        result.emplace_back(word);
+        return true;
+    });
+    return result;
+}
+
+int main() {
+    // ASCII words are returned as they are, without copying
+    std::string out = "untouched";
+    std::string_view ascii = "hello, world";
+    CHECK(casefold::foldUtf8(ascii, out).data() == ascii.data());
+    CHECK_EQ(out, "untouched");
+    CHECK_EQ(fold(""), "");
+    CHECK_EQ(casefold::foldCodePoint('Q'), uint32_t('q'));
+    CHECK_EQ(casefold::foldCodePoint('q'), uint32_t('q'));
+
+    // Latin-1
+    CHECK_EQ(fold("\xC3\x80\xC3\x89\xC3\x8E\xC3\x95\xC3\x9C"), "\xC3\xA0\xC3\xA9\xC3\xAE\xC3\xB5\xC3\xBC"); // ÀÉÎÕÜ
+    CHECK_EQ(fold("\xC3\x98"), "\xC3\xB8"); // Ø
+    CHECK_EQ(fold("\xC3\x97"), "\xC3\x97"); // × is not a letter
+    CHECK_EQ(fold("\xC5\xB8"), "\xC3\xBF"); // Ÿ folds into Latin-1
+    CHECK_EQ(fold("\xC2\xB5"), "\xCE\xBC"); // µ folds to Greek mu
+    CHECK_EQ(fold("caf\xC3\x89"), "caf\xC3\xA9");
+
+    // Greek, where both sigmas fold to σ
+    CHECK_EQ(fold("\xCE\xA3\xCE\x8A\xCE\xA3\xCE\xA5\xCE\xA6\xCE\x9F\xCE\xA3"), "\xCF\x83\xCE\xAF\xCF\x83\xCF\x85\xCF\x86\xCE\xBF\xCF\x83"); // ΣΊΣΥΦΟΣ
+    CHECK_EQ(fold("\xCF\x82"), "\xCF\x83"); // ς
+    CHECK_EQ(fold("\xCF\x83"), "\xCF\x83"); // σ
+
+    // Simple folding keeps ẞ one letter rather than expanding it to "ss"
+    CHECK_EQ(fold("\xE1\xBA\x9E"), "\xC3\x9F"); // ẞ
+    CHECK_EQ(fold("\xC3\x9F"), "\xC3\x9F"); // ß
+
+    // Cherokee folds lowercase to uppercase
+    CHECK_EQ(casefold::foldCodePoint(0x13F8), 0x13F0u);
+    CHECK_EQ(casefold::foldCodePoint(0xAB70), 0x13A0u);
+    CHECK_EQ(casefold::foldCodePoint(0xABBF), 0x13EFu);
+    CHECK_EQ(casefold::foldCodePoint(0x13A0), 0x13A0u);
+    CHECK_EQ(fold("\xEA\xAD\xB0"), "\xE1\x8E\xA0"); // ꭰ
+
+    // Latin Extended-A alternates upper and lower case, folded by ranges of stride 2
+    CHECK_EQ(casefold::foldCodePoint(0x100), 0x101u); // Ā
+    CHECK_EQ(casefold::foldCodePoint(0x101), 0x101u);
+    CHECK_EQ(casefold::foldCodePoint(0x12E), 0x12Fu); // Į
+    CHECK_EQ(casefold::foldCodePoint(0x132), 0x133u); // Ĳ
+    CHECK_EQ(casefold::foldCodePoint(0x138), 0x138u); // ĸ sits between two ranges
+    CHECK_EQ(casefold::foldCodePoint(0x149), 0x149u);
+    CHECK_EQ(casefold::foldCodePoint(0x14A), 0x14Bu); // Ŋ
+    CHECK_EQ(casefold::foldCodePoint(0x176), 0x177u); // Ŷ
+    CHECK_EQ(fold("\xC5\x81\xC3\xB3\xC4\x8F\xC5\xBA"), "\xC5\x82\xC3\xB3\xC4\x8F\xC5\xBA"); // Łóďź
+
+    // Four-byte code points: Deseret
+    CHECK_EQ(casefold::foldCodePoint(0x10400), 0x10428u);
+    CHECK_EQ(casefold::foldCodePoint(0x10428), 0x10428u);
+    CHECK_EQ(fold("\xF0\x90\x90\x80\xF0\x90\x90\x81"), "\xF0\x90\x90\xA8\xF0\x90\x90\xA9"); // 𐐀𐐁
+
+    // Folding is idempotent, and every folded code point survives encoding and decoding
+    for (uint32_t cp = 0; cp <= 0x10FFFF; cp++) {
+        if (cp >= 0xD800 && cp <= 0xDFFF) continue;
+        uint32_t folded = casefold::foldCodePoint(cp);
+        if (casefold::foldCodePoint(folded) != folded) CHECK_EQ(casefold::foldCodePoint(folded), folded);
+        std::string encoded = utf8(cp);
+        uint32_t decoded = 0;
+        size_t length = casefold::decodeUtf8(reinterpret_cast<const unsigned char*>(encoded.data()), encoded.size(), decoded);
+        if (length != encoded.size() || decoded != cp) CHECK_EQ(decoded, cp);
+    }
+
+    // Invalid sequences are rejected by the decoder and copied through unchanged
+    std::vector<std::string> invalid = {
+        "\xC0\xAF", "\xC1\xBF", "\xE0\x80\xAF", "\xF0\x80\x80\xAF", // Overlong
+        "\xC3", "\xE2\x82", "\xF0\x90\x90", // Truncated
+        "\xED\xA0\x80", "\xED\xBF\xBF", // Surrogates
+        "\xF4\x90\x80\x80", "\xF7\xBF\xBF\xBF", // Past U+10FFFF
+        "\x80", "\xBF", "\xF8\x88\x80\x80\x80", "\xFF" // Stray continuation and invalid lead bytes
+    };
+    for (const auto& sequence : invalid) {
+        uint32_t cp;
+        CHECK_EQ(casefold::decodeUtf8(reinterpret_cast<const unsigned char*>(sequence.data()), sequence.size(), cp), 0u);
+        CHECK_EQ(fold(sequence), sequence);
+        CHECK_EQ(fold("x" + sequence + "\xC3\x89"), "x" + sequence + "\xC3\xA9");
+    }
+    CHECK_EQ(fold("\xC3\xC3\x89"), "\xC3\xC3\xA9"); // A lead byte cut short by the next character
+
+    // End to end: ASCII-only text never reaches folding, mixed text folds every word
+    CHECK(words("Hello World") == (std::vector<std::string>{ "hello", "world" }));
+    CHECK(words("") == std::vector<std::string>{});
+    CHECK(words("Hello \xCE\x9A\xCE\x8C\xCE\xA3\xCE\x9C\xCE\x95  Stra\xC3\x9F" "E\t\xE1\xBA\x9EIG\n\xF0\x90\x90\x80\xF0\x90\x90\x81 \xC3 OK a\xC2\xA0" "B")
+        == (std::vector<std::string>{ "hello", "\xCE\xBA\xCF\x8C\xCF\x83\xCE\xBC\xCE\xB5", "stra\xC3\x9F" "e", "\xC3\x9Fig",
+            "\xF0\x90\x90\xA8\xF0\x90\x90\xA9", "\xC3", "ok", "a\xC2\xA0" "b" }));
+    // Non-ASCII beyond the first 64-byte block still switches folding on for the whole text
+    std::string longText = std::string(70, 'A') + " \xC3\x89T\xC3\x89";
+    CHECK(words(longText) == (std::vector<std::string>{ std::string(70, 'a'), "\xC3\xA9t\xC3\xA9" }));
+
+    return check::result("casefold_test");
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <iostream>
+
+// Checks for the unit tests: a failed check prints where it is and what it compared, and main
+// returns check::result() so ctest sees a non-zero exit
+namespace check {
+
+inline int failures = 0;
+
+inline int result(const char* test) {
+    if (failures > 0) std::cerr << test << ": " << failures << " checks failed" << std::endl;
+    else std::cout << test << ": all checks passed" << std::endl;
+    return failures > 0 ? 1 : 0;
+}
+
+}
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed" << std::endl; \
+            check::failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(actual, expected) \
+    do { \
+        const auto& actualValue = (actual); \
+        const auto& expectedValue = (expected); \
+        if (!(actualValue == expectedValue)) { \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK_EQ(" #actual ", " #expected ") failed: " \
+                << actualValue << " != " << expectedValue << std::endl; \
+            check::failures++; \
+        } \
+    } while (0)
@@ -0,0 +1,46 @@
+#include <fstream>
+#include <string>
+#include <string_view>
+#include "check.h"
+#include "../src/english_stemmer.h"
+
+// Function to stem a word into a buffer of its own size, as the tokenizer does
+std::string stem(std::string_view word) {
+    std::string out(word.size(), '\0');
+    out.resize(EnglishStemmer::stem(word, out.data()));
+    return out;
+}
+
+int main() {
+    // english_stems.txt holds a word and the stem libstemmer's "english" algorithm gives it per line:
+    // a sample of a large English word list plus the words the Porter2 rules treat specially
+    std::ifstream in("english_stems.txt");
+    CHECK(in.good());
+    size_t pairs = 0;
+    for (std::string line; std::getline(in, line);) {
+        size_t space = line.find(' ');
+        if (space == std::string::npos) continue;
+        std::string word = line.substr(0, space), expected = line.substr(space + 1);
+        CHECK(EnglishStemmer::supports(word));
+        CHECK_EQ(stem(word), expected);
+        pairs++;
+    }
+    CHECK(pairs > 2000);
+
+    // Stemming runs in place as well
+    std::string word = "generously";
+    word.resize(EnglishStemmer::stem(word, word.data()));
+    CHECK_EQ(word, "generous");
+
+    // Empty input stems to nothing
+    CHECK(EnglishStemmer::supports(""));
+    CHECK_EQ(stem(""), "");
+
+    // Non-ASCII words are left to libstemmer
+    CHECK(!EnglishStemmer::supports("caf\xC3\xA9"));
+    CHECK(!EnglishStemmer::supports("na\xC3\xAFve"));
+    CHECK(!EnglishStemmer::supports("\xE2\x80\x99s"));
+    CHECK(EnglishStemmer::supports("cafe"));
+
+    return check::result("english_stemmer_test");
+}
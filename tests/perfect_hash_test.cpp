@@ -0,0 +1,63 @@
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include "check.h"
+#include "../src/perfect_hash.h"
+
+// Function to find the slot of a key in a built table, as PerfectHashVocabulary does
+uint32_t slotOf(const perfect_hash::Table& table, std::string_view key) {
+    uint64_t hash = perfect_hash::hashOf(key);
+    uint32_t pilot = table.pilots[perfect_hash::bucketOf(hash, uint32_t(table.pilots.size()))];
+    return perfect_hash::slotOf(hash, pilot, uint32_t(table.ids.size()));
+}
+
+// Function to check that a table maps its keys one to one onto its slots, each slot holding its key and id
+void checkTable(const std::vector<std::pair<std::string, int32_t>>& entries) {
+    perfect_hash::Table table = perfect_hash::build(entries);
+    CHECK_EQ(table.ids.size(), entries.size());
+    CHECK_EQ(table.offsets.size(), entries.size() + 1);
+    CHECK_EQ(table.pilots.size(), size_t(perfect_hash::bucketCount(uint32_t(entries.size()))));
+    CHECK_EQ(size_t(table.offsets.back()), table.keys.size());
+
+    std::vector<bool> used(entries.size(), false);
+    for (const auto& [key, id] : entries) {
+        uint32_t slot = slotOf(table, key);
+        if (slot >= entries.size()) {
+            CHECK(slot < entries.size());
+            continue;
+        }
+        CHECK(!used[slot]);
+        used[slot] = true;
+        CHECK_EQ(table.keys.substr(table.offsets[slot], table.offsets[slot + 1] - table.offsets[slot]), key);
+        CHECK_EQ(table.ids[slot], id);
+    }
+}
+
+int main() {
+    // Small tables, including the empty key and keys with non-ASCII bytes
+    checkTable({});
+    checkTable({ {"apple", 1} });
+    checkTable({ {"", 7}, {"apple", 1} });
+    checkTable({ {"apple", 1}, {"banana", 2}, {"caf\xC3\xA9", 3}, {"\xFF", 4}, {"a", 5} });
+
+    // Sizes around bucket boundaries, powers of two and a large table
+    for (uint32_t size : { 3u, 4u, 5u, 8u, 9u, 16u, 100u, 1000u, 1024u, 65536u, 100000u }) {
+        std::vector<std::pair<std::string, int32_t>> entries;
+        for (uint32_t i = 0; i < size; i++) entries.emplace_back("word" + std::to_string(i), int32_t(i * 3 + 1));
+        checkTable(entries);
+    }
+
+    // A repeated key cannot be placed and is reported
+    bool refused = false;
+    try {
+        perfect_hash::build({ {"apple", 1}, {"banana", 2}, {"apple", 3} });
+    }
+    catch (const std::runtime_error&) {
+        refused = true;
+    }
+    CHECK(refused);
+
+    return check::result("perfect_hash_test");
+}
@@ -0,0 +1,117 @@
+#include <cctype>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+#include "check.h"
+#include "../src/text_simd.h"
+
+// Struct to hold what a kernel produced for a text
+struct Result {
+    std::string lowered;
+    std::vector<uint64_t> spaces;
+    bool ascii;
+};
+
+Result run(text_simd::Kernel kernel, const std::string& text) {
+    Result result{ std::string(text.size(), '\0'), std::vector<uint64_t>((text.size() + 63) / 64), false };
+    result.ascii = kernel(text.data(), result.lowered.data(), text.size(), result.spaces.data());
+    return result;
+}
+
+// Function to split text the way istream extraction and tolower did in the "C" locale
+std::vector<std::string> referenceWords(const std::string& text) {
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : text) {
+        if (std::isspace(static_cast<unsigned char>(c)) && static_cast<unsigned char>(c) < 0x80) {
+            if (!word.empty()) words.push_back(std::move(word));
+            word.clear();
+        }
+        else {
+            word.push_back(static_cast<unsigned char>(c) < 0x80 ? char(std::tolower(static_cast<unsigned char>(c))) : c);
+        }
+    }
+    if (!word.empty()) words.push_back(std::move(word));
+    return words;
+}
+
+std::vector<std::string> kernelWords(text_simd::Kernel kernel, const std::string& text) {
+    Result result = run(kernel, text);
+    std::vector<std::string> words;
+    text_simd::forEachWord(result.spaces.data(), text.size(), [&](size_t begin, size_t end) {
+        words.push_back(result.lowered.substr(begin, end - begin));
+        return true;
+    });
+    return words;
+}
+
+int main() {
+    std::vector<std::pair<const char*, text_simd::Kernel>> kernels = { {"scalar", text_simd::lowerScalar} };
+#if defined(BLOCKTHETWEET_X86)
+    kernels.emplace_back("sse2", text_simd::lowerSse2);
+#if defined(__GNUC__)
+    if (__builtin_cpu_supports("avx2")) kernels.emplace_back("avx2", text_simd::lowerAvx2);
+#endif
+#elif defined(BLOCKTHETWEET_NEON)
+    kernels.emplace_back("neon", text_simd::lowerNeon);
+#endif
+
+    // Every byte value, at every position of a block, against the "C" locale
+    std::string bytes;
+    for (int c = 0; c < 256; c++) bytes.push_back(char(c));
+    for (const auto& [name, kernel] : kernels) {
+        Result result = run(kernel, bytes);
+        CHECK(!result.ascii);
+        for (int c = 0; c < 256; c++) {
+            bool space = c < 0x80 && std::isspace(c);
+            CHECK_EQ(int(static_cast<unsigned char>(result.lowered[c])), c < 0x80 ? std::tolower(c) : c);
+            CHECK_EQ(bool(result.spaces[c / 64] >> (c % 64) & 1), space);
+        }
+        CHECK(run(kernel, bytes.substr(0, 128)).ascii);
+    }
+
+    // Empty input writes nothing and is ASCII
+    for (const auto& [name, kernel] : kernels) {
+        uint64_t spaces = 12345;
+        char out = 'x';
+        CHECK(kernel("", &out, 0, &spaces));
+        CHECK_EQ(spaces, 12345u);
+        CHECK_EQ(out, 'x');
+        CHECK(kernelWords(kernel, "").empty());
+        CHECK(kernelWords(kernel, " \t\r\n").empty());
+    }
+
+    // Random texts of every length around the block sizes agree with the scalar kernel and the
+    // reference split, with non-ASCII bytes in some of them
+    std::mt19937 random(1);
+    const std::string alphabet = " \t\n\v\f\rAZaz@[`{09!\x1f\x7f\x80\xC3\xA9\xFF";
+    for (int i = 0; i < 20000; i++) {
+        std::string text(random() % 300, ' ');
+        for (auto& c : text) c = random() % 10 < 6 ? char('A' + random() % 58) : alphabet[random() % alphabet.size()];
+        if (random() % 2) {
+            for (auto& c : text) {
+                if (static_cast<unsigned char>(c) >= 0x80) c = 'x';
+            }
+        }
+
+        Result expected = run(text_simd::lowerScalar, text);
+        std::vector<std::string> words = referenceWords(text);
+        for (const auto& [name, kernel] : kernels) {
+            Result result = run(kernel, text);
+            CHECK_EQ(result.lowered, expected.lowered);
+            CHECK(result.spaces == expected.spaces);
+            CHECK_EQ(result.ascii, expected.ascii);
+            CHECK(kernelWords(kernel, text) == words);
+        }
+    }
+
+    // Returning false stops the walk
+    std::string text = "one two three";
+    Result result = run(text_simd::lowerScalar, text);
+    size_t visited = 0;
+    text_simd::forEachWord(result.spaces.data(), text.size(), [&](size_t, size_t) { return ++visited < 2; });
+    CHECK_EQ(visited, 2u);
+
+    return check::result("text_simd_test");
+}
@@ -0,0 +1,65 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include "check.h"
+#include "../src/vocabulary.h"
+
+// Function to check every word of a word index and a few missing ones, singly and in a batch
+void checkVocabulary(const Vocabulary& vocabulary, const nlohmann::json& wordIndex) {
+    CHECK_EQ(vocabulary.size(), wordIndex.size());
+    for (const auto& [word, id] : wordIndex.items()) CHECK_EQ(vocabulary.lookup(word), id.get<int64_t>());
+
+    std::vector<std::string_view> missing = { "", "missing", "a", "zz", "apple!", "appl", "applesauce" };
+    for (auto word : missing) {
+        if (!wordIndex.contains(word)) CHECK_EQ(vocabulary.lookup(word), 0);
+    }
+
+    std::vector<std::string> words;
+    for (const auto& [word, id] : wordIndex.items()) words.push_back(word);
+    for (auto word : missing) words.emplace_back(word);
+    std::vector<std::string_view> views(words.begin(), words.end());
+    std::vector<int64_t> ids(views.size(), -1);
+    vocabulary.lookupBatch(views.data(), views.size(), ids.data());
+    for (size_t i = 0; i < views.size(); i++) CHECK_EQ(ids[i], vocabulary.lookup(views[i]));
+
+    size_t visited = 0;
+    vocabulary.forEach([&](std::string_view word, int64_t id) {
+        CHECK_EQ(id, wordIndex.value(std::string(word), int64_t(-1)));
+        visited++;
+    });
+    CHECK_EQ(visited, wordIndex.size());
+}
+
+// Function to build the perfect hash layout of a word index, as gen_vocabulary and bundles do
+perfect_hash::Table buildTable(const nlohmann::json& wordIndex) {
+    std::vector<std::pair<std::string, int32_t>> entries;
+    for (const auto& [word, id] : wordIndex.items()) entries.emplace_back(word, id.get<int32_t>());
+    return perfect_hash::build(entries);
+}
+
+int main() {
+    nlohmann::json large = nlohmann::json::object();
+    for (int i = 0; i < 5000; i++) large["word" + std::to_string(i * 7919 % 100003)] = i + 1;
+    // Words sharing long prefixes across front coding blocks
+    for (int i = 0; i < 100; i++) large["apple" + std::string(i % 20, 's') + std::to_string(i)] = 6000 + i;
+    large["apple"] = 7000;
+
+    // Tables of 0, 1 and 2 words used to fill up, so probes for missing words never stopped
+    std::vector<nlohmann::json> indexes = {
+        nlohmann::json::object(),
+        { {"apple", 1} },
+        { {"apple", 1}, {"banana", 2} },
+        { {"apple", 1}, {"banana", 2}, {"cherry", 3} },
+        large
+    };
+    for (const auto& wordIndex : indexes) {
+        checkVocabulary(PackedVocabulary(wordIndex), wordIndex);
+
+        perfect_hash::Table table = buildTable(wordIndex);
+        PerfectHashVocabulary perfect(table.pilots.data(), uint32_t(table.pilots.size()), table.offsets.data(), table.ids.data(),
+            table.keys.data(), uint32_t(table.ids.size()));
+        checkVocabulary(perfect, wordIndex);
+    }
+
+    return check::result("vocabulary_test");
+}
@@ -0,0 +1,116 @@
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "check.h"
+#include "../src/word_fst.h"
+
+// Function to compile words into a temporary FST file and open it
+std::unique_ptr<word_fst::WordFst> compile(const std::vector<std::pair<std::string, int32_t>>& words) {
+    std::string path = (std::filesystem::temp_directory_path() / "word_fst_test.fst").string();
+    word_fst::WordFstBuilder::write(path, words, 42, "english");
+    auto fst = word_fst::WordFst::open(path);
+    std::remove(path.c_str());
+    return fst;
+}
+
+// Function to check that every word maps to its id and that the missing words map to nothing
+void checkFst(const word_fst::WordFst& fst, const std::map<std::string, int32_t>& words, const std::vector<std::string>& missing) {
+    for (const auto& [word, expected] : words) {
+        int64_t id = -1;
+        CHECK(fst.lookup(word, id));
+        CHECK_EQ(id, expected);
+    }
+    for (const auto& word : missing) {
+        if (words.count(word)) continue;
+        int64_t id = -1;
+        CHECK(!fst.lookup(word, id));
+        CHECK_EQ(id, -1);
+    }
+}
+
+int main() {
+    // Words sharing prefixes and suffixes, so states are merged both ways, plus non-ASCII bytes
+    std::vector<std::pair<std::string, int32_t>> words = {
+        {"run", 1}, {"runs", 2}, {"running", 3}, {"runner", 4}, {"ran", 5}, {"walking", 6}, {"talking", 7},
+        {"talks", 8}, {"a", 9}, {"caf\xC3\xA9", 10}, {"na\xC3\xAFve", 11}, {"zzz", 12}, {"", 13}, {"run", 14}
+    };
+    auto fst = compile(words);
+    CHECK_EQ(fst->header().wordCount, 12u); // The empty word is dropped and "run" kept once
+    CHECK_EQ(fst->header().vocabularyHash, 42u);
+    CHECK_EQ(std::string(fst->header().language), "english");
+    std::map<std::string, int32_t> expected = {
+        {"run", 1}, {"runs", 2}, {"running", 3}, {"runner", 4}, {"ran", 5}, {"walking", 6}, {"talking", 7},
+        {"talks", 8}, {"a", 9}, {"caf\xC3\xA9", 10}, {"na\xC3\xAFve", 11}, {"zzz", 12}
+    };
+    checkFst(*fst, expected, { "", "r", "ru", "runn", "runningg", "walk", "talk", "alking", "b", "cafe", "caf\xC3", "zz", "zzzz", "RUN" });
+
+    // A larger set of random words, looked up along with one-letter edits of them
+    std::mt19937 random(7);
+    std::map<std::string, int32_t> many;
+    std::vector<std::pair<std::string, int32_t>> manyWords;
+    while (many.size() < 20000) {
+        std::string word(1 + random() % 12, 'a');
+        for (auto& c : word) c = char('a' + random() % 6);
+        int32_t id = int32_t(random() % 100000);
+        if (many.emplace(word, id).second) manyWords.emplace_back(word, id);
+    }
+    std::vector<std::string> edits;
+    for (const auto& [word, id] : manyWords) {
+        edits.push_back(word + "g");
+        edits.push_back(word.substr(0, word.size() - 1));
+    }
+    checkFst(*compile(manyWords), many, edits);
+
+    // An FST of no words accepts nothing
+    auto empty = compile({});
+    CHECK_EQ(empty->header().wordCount, 0u);
+    checkFst(*empty, {}, { "", "a", "run" });
+
+    // Words far longer than the call stack could recurse over build and look up
+    std::string longWord(1000000, 'a');
+    auto deep = compile({ {longWord, 1}, {longWord + "b", 2}, {"a", 3} });
+    checkFst(*deep, { {longWord, 1}, {longWord + "b", 2}, {"a", 3} }, { longWord.substr(1), longWord + "a", "aa" });
+
+    // Files that are not complete FSTs, or whose tables point outside themselves, are refused
+    std::string path = (std::filesystem::temp_directory_path() / "word_fst_test_bad.fst").string();
+    auto refused = [&](size_t offset, const void* value, size_t length, bool truncate) {
+        word_fst::WordFstBuilder::write(path, words, 42, "english");
+        if (truncate) {
+            std::filesystem::resize_file(path, std::filesystem::file_size(path) - 4);
+        }
+        else {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(std::streamoff(offset));
+            file.write(static_cast<const char*>(value), std::streamsize(length));
+        }
+        bool thrown = false;
+        try {
+            word_fst::WordFst::open(path);
+        }
+        catch (const std::runtime_error&) {
+            thrown = true;
+        }
+        std::remove(path.c_str());
+        return thrown;
+    };
+    const word_fst::Header& header = fst->header();
+    size_t statesOffset = sizeof(word_fst::Header);
+    size_t transitionsOffset = statesOffset + (size_t(header.stateCount) + 1) * sizeof(word_fst::State)
+        + word_fst::paddedLabelBytes(header.transitionCount);
+    uint32_t huge = 0x7FFFFFFF, zero = 0;
+    CHECK(refused(0, nullptr, 0, true));
+    CHECK(refused(transitionsOffset, &huge, sizeof(huge), false)); // First transition's target
+    CHECK(refused(transitionsOffset + offsetof(word_fst::Transition, skip), &huge, sizeof(huge), false)); // Its rank skip
+    CHECK(refused(statesOffset + sizeof(word_fst::State), &huge, sizeof(huge), false)); // Second state's first transition
+    CHECK(refused(transitionsOffset, &zero, sizeof(zero), false)); // A transition back to the root
+    CHECK(!refused(0, nullptr, 0, false));
+
+    return check::result("word_fst_test");
+}
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+"""Generate src/casefold_table.h, the range table behind casefold.h.
+
+Each code point maps to its simple case folding (CaseFolding.txt statuses C and S): the one-code-point
+result of str.casefold(), or of str.lower() where full folding expands (e.g. U+1E9E folds to U+00DF).
+Runs of code points sharing a delta, either contiguous or alternating upper/lower pairs, collapse into
+one range entry.
+
+Usage: python3 tools/gen_casefold.py > src/casefold_table.h
+"""
+
+import sys
+import unicodedata
+
+
+def simple_fold(cp):
+    c = chr(cp)
+    folded = c.casefold()
+    if len(folded) != 1:
+        folded = c.lower()
+    return ord(folded) if len(folded) == 1 else cp
+
+
+def main():
+    mapping = [(cp, simple_fold(cp) - cp) for cp in range(0x80, 0x110000)
+               if not 0xD800 <= cp <= 0xDFFF and simple_fold(cp) != cp]
+
+    # Greedily extend each range with the stride its first two members agree on
+    ranges = []
+    i = 0
+    while i < len(mapping):
+        first, delta = mapping[i]
+        stride, count = 1, 1
+        if i + 1 < len(mapping) and mapping[i + 1][1] == delta and mapping[i + 1][0] - first in (1, 2):
+            stride = mapping[i + 1][0] - first
+            while i + count < len(mapping) and mapping[i + count] == (first + count * stride, delta):
+                count += 1
+        ranges.append((first, count, stride, delta))
+        i += count
+
+    # The lookup binary-searches on first, so no range may reach past the start of the next one
+    for current, following in zip(ranges, ranges[1:]):
+        assert current[0] + (current[1] - 1) * current[2] < following[0], (current, following)
+    assert all(count < 1 << 16 for _, count, _, _ in ranges)
+
+    out = sys.stdout
+    out.write("#pragma once\n\n")
+    out.write("// Generated by tools/gen_casefold.py from Unicode %s; do not edit\n\n" % unicodedata.unidata_version)
+    out.write("#include <cstdint>\n\n")
+    out.write("namespace casefold {\n\n")
+    out.write("// Range of code points folded by adding delta: first, first + stride, ... (count of them)\n")
+    out.write("struct FoldRange {\n    uint32_t first;\n    uint16_t count;\n    uint8_t stride;\n    int32_t delta;\n};\n\n")
+    out.write("inline constexpr FoldRange FOLD_RANGES[] = {\n")
+    for first, count, stride, delta in ranges:
+        out.write("    { 0x%05X, %d, %d, %d },\n" % (first, count, stride, delta))
+    out.write("};\n\n}\n")
+
+
+if __name__ == "__main__":
+    main()
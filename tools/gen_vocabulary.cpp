@@ -0,0 +1,79 @@
+// Build-time generator of embedded_vocabulary_data.h, the table behind src/embedded_vocabulary.h.
+//
+// Reads a word index (JSON object of word to token id) and lays it out as a minimal perfect hash
+// table (src/perfect_hash.h): pilots per bucket, then keys, offsets and ids in slot order.
+//
+// Usage: gen_vocabulary <word_index.json> <embedded_vocabulary_data.h>
+
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+#include "../libs/nlohmann/json.hpp"
+#include "../libs/xxhash/xxhash.h"
+#include "../src/perfect_hash.h"
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        std::cerr << "Usage: " << argv[0] << " <word_index.json> <embedded_vocabulary_data.h>" << std::endl;
+        return 1;
+    }
+
+    std::ifstream f(argv[1], std::ios::binary);
+    if (!f) {
+        std::cerr << "Error: cannot open word index: " << argv[1] << std::endl;
+        return 1;
+    }
+    std::string contents((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+
+    perfect_hash::Table table;
+    try {
+        nlohmann::json wordIndex = nlohmann::json::parse(contents);
+        if (!wordIndex.is_object()) throw std::invalid_argument("word index must be a JSON object");
+        std::vector<std::pair<std::string, int32_t>> entries;
+        for (const auto& [word, id] : wordIndex.items()) {
+            int64_t value = id.get<int64_t>();
+            if (value < INT32_MIN || value > INT32_MAX) throw std::out_of_range("token id out of int32 range: " + word);
+            entries.emplace_back(word, int32_t(value));
+        }
+        table = perfect_hash::build(entries);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << argv[1] << ": " << e.what() << std::endl;
+        return 1;
+    }
+
+    std::ofstream out(argv[2], std::ios::trunc);
+    if (!out) {
+        std::cerr << "Error: cannot write: " << argv[2] << std::endl;
+        return 1;
+    }
+    auto writeArray = [&](const char* type, const char* name, const auto& values) {
+        out << "inline constexpr " << type << " " << name << "[] = {";
+        for (size_t i = 0; i < values.size(); i++) out << (i % 16 == 0 ? "\n    " : " ") << int64_t(values[i]) << ",";
+        if (values.empty()) out << "\n    0,";
+        out << "\n};\n\n";
+    };
+
+    out << "// Generated by tools/gen_vocabulary from " << argv[1] << "; do not edit.\n"
+        << "#pragma once\n\n"
+        << "#include <cstdint>\n\n"
+        << "namespace embedded_vocabulary {\n\n"
+        << "inline constexpr uint64_t WORD_INDEX_HASH = " << XXH64(contents.data(), contents.size(), 0) << "ull;\n"
+        << "inline constexpr uint32_t WORD_COUNT = " << table.ids.size() << ";\n"
+        << "inline constexpr uint32_t BUCKET_COUNT = " << table.pilots.size() << ";\n\n";
+    writeArray("uint32_t", "PILOTS", table.pilots);
+    writeArray("uint32_t", "OFFSETS", table.offsets);
+    writeArray("int32_t", "IDS", table.ids);
+    writeArray("unsigned char", "KEYS", std::vector<unsigned char>(table.keys.begin(), table.keys.end()));
+    out << "}\n";
+    if (!out) {
+        std::cerr << "Error: cannot write: " << argv[2] << std::endl;
+        return 1;
+    }
+    std::cout << "Embedded " << table.ids.size() << " words in " << table.pilots.size() << " buckets: " << argv[2] << std::endl;
+    return 0;
+}